@@ -21,6 +21,10 @@ const chain_message_type subscribe_message::type = chain_message_type::subscribe
 const chain_message_type block_message::type = chain_message_type::block_msg;
 const chain_message_type trx_message::type = chain_message_type::trx_msg;
 const chain_message_type trx_err_message::type = chain_message_type::trx_err_msg;
+const chain_message_type match_filters_message::type = chain_message_type::match_filters_msg;
+const chain_message_type match_filters_reply_message::type = chain_message_type::match_filters_reply_msg;
+const chain_message_type trx_proof_message::type = chain_message_type::trx_proof_msg;
+const chain_message_type trx_proof_reply_message::type = chain_message_type::trx_proof_reply_msg;
 
   namespace detail
   {
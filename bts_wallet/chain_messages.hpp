@@ -9,10 +9,13 @@ enum chain_message_type
     subscribe_msg = 1,
     block_msg     = 2,
     trx_msg       = 3,
-    trx_err_msg   = 4
-
+    trx_err_msg   = 4,
+    match_filters_msg       = 5,
+    match_filters_reply_msg = 6,
+    trx_proof_msg           = 7,
+    trx_proof_reply_msg     = 8
 };
-FC_REFLECT_ENUM( chain_message_type, (subscribe_msg)(block_msg)(trx_msg)(trx_err_msg) )
+FC_REFLECT_ENUM( chain_message_type, (subscribe_msg)(block_msg)(trx_msg)(trx_err_msg)(match_filters_msg)(match_filters_reply_msg)(trx_proof_msg)(trx_proof_reply_msg) )
 
 struct subscribe_message
 {
@@ -46,3 +49,50 @@ struct trx_err_message
    std::string                            err;
 };
 FC_REFLECT( trx_err_message, (signed_trx)(err) )
+
+/**
+ *  Asks for the blocks starting at from_block that may reference one of
+ *  addresses according to their address filters.  At most
+ *  BITSHARE_MAX_FILTER_ADDRESSES addresses are accepted per request.
+ */
+struct match_filters_message
+{
+   static const chain_message_type type;
+   match_filters_message():from_block(0){}
+   std::vector<bts::address>              addresses;
+   uint32_t                               from_block;
+};
+FC_REFLECT( match_filters_message, (addresses)(from_block) )
+
+/**
+ *  At most BITSHARE_MAX_FILTER_BLOCKS blocks are matched per request, the
+ *  next request should start after last_block.
+ */
+struct match_filters_reply_message
+{
+   static const chain_message_type type;
+   match_filters_reply_message():last_block(0){}
+   std::vector<uint32_t>                  block_nums;
+   uint32_t                               last_block;
+};
+FC_REFLECT( match_filters_reply_message, (block_nums)(last_block) )
+
+/**
+ *  Asks for the header of the block that includes trx_id and the merkle
+ *  branch that proves it, see bts::blockchain::verify_trx_branch().
+ */
+struct trx_proof_message
+{
+   static const chain_message_type type;
+   bts::blockchain::transaction_id_type   trx_id;
+};
+FC_REFLECT( trx_proof_message, (trx_id) )
+
+struct trx_proof_reply_message
+{
+   static const chain_message_type type;
+   bts::blockchain::transaction_id_type   trx_id;
+   bts::blockchain::block_header          header;
+   bts::merkle_branch                     branch;
+};
+FC_REFLECT( trx_proof_reply_message, (trx_id)(header)(branch) )
@@ -5,7 +5,9 @@
 #include <mail/message.hpp>
 #include <mail/stcp_socket.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/blockchain_trx_pool.hpp>
 #include <bts/db/level_map.hpp>
+#include <bts/db/db_environment.hpp>
 #include <fc/time.hpp>
 #include <fc/network/tcp_socket.hpp>
 #include <fc/reflect/variant.hpp>
@@ -57,7 +59,7 @@ namespace detail
    {
       public:
         chain_server_impl()
-        :ser_del(nullptr)
+        :ser_del(nullptr),pool(chain)
         {}
 
         ~chain_server_impl()
@@ -103,7 +105,6 @@ namespace detail
                                                                    
         fc::future<void>                                            accept_loop_complete;
         fc::future<void>                                            block_gen_loop_complete;
-        std::vector<bts::blockchain::signed_transaction>            pending;
 
 
         void block_gen_loop()
@@ -113,17 +114,16 @@ namespace detail
                 {
                    fc::usleep( fc::seconds(20) );
 
-                   auto order_trxs   = chain.match_orders(); 
-                   pending.insert( pending.end(), order_trxs.begin(), order_trxs.end() );
-                   if( pending.size() )
+                   pool.remove_expired( fc::time_point::now() );
+                   auto new_block = chain.generate_next_block( pool.select() );
+                   if( new_block.trxs.size() )
                    {
-                      auto new_block = chain.generate_next_block( pending );
-                      pending.clear();
-                      if( new_block.trxs.size() )
-                      {
-                        chain.push_block( new_block );
-                        fc::async( [=](){ broadcast_block(new_block); } );
-                      }
+                     chain.push_block( new_block );
+                     pool.block_pushed( new_block );
+                     fc::async( [=](){ broadcast_block(new_block); } );
+                     ilog( "signature cache: ${s}  pending trxs: ${p}", 
+                           ("s", chain.get_signature_cache_stats())("p",pool.size()) );
+                     ilog( "db caches: ${c}", ("c", chain.get_db_cache_stats()) );
                    }
                 }
              } 
@@ -180,8 +180,7 @@ namespace detail
                 ilog( "recv: ${m}", ("m",trx) );
                 try 
                 {
-                   chain.evaluate_signed_transaction( trx.signed_trx );
-                   pending.push_back(trx.signed_trx);
+                   pool.add( trx.signed_trx );
                 } 
                 catch ( const fc::exception& e )
                 {
@@ -193,6 +192,48 @@ namespace detail
                    c.close();
                 }
              }
+             else if( m.type == chain_message_type::match_filters_msg )
+             {
+                auto req = m.as<match_filters_message>();
+                ilog( "recv: ${m}", ("m",req) );
+                if( req.addresses.size() > BITSHARE_MAX_FILTER_ADDRESSES )
+                {
+                   trx_err_message reply;
+                   reply.err = "too many addresses to match";
+                   wlog( "${n} addresses to match", ("n",req.addresses.size()) );
+                   c.send( message( reply ) );
+                   c.close();
+                }
+                else
+                {
+                   // the span is capped too, the client continues after last_block
+                   match_filters_reply_message reply;
+                   reply.last_block = std::min( chain.head_block_num(),
+                                                std::max( req.from_block, req.from_block + BITSHARE_MAX_FILTER_BLOCKS - 1 ) );
+                   reply.block_nums = chain.match_address_filters( req.addresses, req.from_block, reply.last_block );
+                   c.send( message( reply ) );
+                }
+             }
+             else if( m.type == chain_message_type::trx_proof_msg )
+             {
+                auto req = m.as<trx_proof_message>();
+                ilog( "recv: ${m}", ("m",req) );
+                try
+                {
+                   trx_proof_reply_message reply;
+                   reply.trx_id = req.trx_id;
+                   reply.branch = chain.fetch_trx_branch( req.trx_id );
+                   reply.header = chain.fetch_block( chain.fetch_trx_num( req.trx_id ).block_num );
+                   c.send( message( reply ) );
+                }
+                catch ( const fc::exception& e )
+                {
+                   trx_err_message reply;
+                   reply.err = e.to_detail_string();
+                   wlog( "${e}", ("e", e.to_detail_string() ) );
+                   c.send( message( reply ) );
+                }
+             }
              else
              {
                  trx_err_message reply;
@@ -294,6 +335,7 @@ namespace detail
            }
         }
         bts::blockchain::blockchain_db chain;
+        bts::blockchain::trx_pool      pool;
    };
 }
 
@@ -322,13 +364,26 @@ void chain_server::configure( const chain_server::config& c )
      my->accept_loop_complete = fc::async( [=](){ my->accept_loop(); } ); 
      my->block_gen_loop_complete = fc::async( [=](){ my->block_gen_loop(); } ); 
      
+     bts::db::db_environment::instance().set_block_cache_size( c.db_cache_size );
      my->chain.open( "chain" );
+     if( c.index_addresses )
+     {
+         my->chain.enable_address_index();
+     }
+     for( auto itr = c.checkpoints.begin(); itr != c.checkpoints.end(); ++itr )
+     {
+         my->chain.add_checkpoint( itr->first, itr->second );
+     }
      if( my->chain.head_block_num() == uint32_t(-1) )
      {
          auto genesis = create_test_genesis_block();
          //ilog( "genesis block: \n${s}", ("s", fc::json::to_pretty_string(genesis) ) );
          my->chain.push_block( genesis );
      }
+     if( c.prune_depth )
+     {
+         my->chain.enable_pruning( c.prune_depth );
+     }
 
   } FC_RETHROW_EXCEPTIONS( warn, "error configuring server", ("config", c) );
 }
@@ -46,8 +46,13 @@
         struct config
         {
             config()
-            :port(0){}
+            :port(0),prune_depth(0),index_addresses(false),db_cache_size(BTS_DB_BLOCK_CACHE_SIZE){}
             uint16_t                 port;  ///< the port to listen for incoming connections on.
+            uint32_t                 prune_depth; ///< blocks of history kept in full, 0 keeps all of it and the block archive
+            bool                     index_addresses; ///< maintain the address to output index
+            uint64_t                 db_cache_size; ///< bytes of LevelDB block cache shared by every database
+            /** trusted (block_num, block id) pairs in addition to the compiled in checkpoints */
+            std::vector< std::pair<uint32_t,bts::blockchain::block_id_type> > checkpoints;
             std::vector<std::string> blacklist;  // host's that are blocked from connecting
             std::vector<fc::ip::endpoint> mirrors;  // host's that are blocked from connecting
         };
@@ -79,4 +84,4 @@
   };
   typedef std::shared_ptr<chain_server> chain_server_ptr;
 
-FC_REFLECT( chain_server::config, (port)(mirrors) )
+FC_REFLECT( chain_server::config, (port)(mirrors)(prune_depth)(index_addresses)(db_cache_size)(checkpoints) )
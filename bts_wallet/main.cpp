@@ -282,6 +282,15 @@ class client : public chain_connection_delegate
              return fc::variant( chain.fetch_block( params[0].as_int64() )  ); 
          });
 
+         con->add_method( "export_snapshot", [=]( const fc::variants& params ) -> fc::variant
+         {
+             check_login( capture_con );
+             FC_ASSERT( params.size() == 1 || params.size() == 2 );
+             uint32_t block_num = params.size() == 2 ? params[1].as<uint32_t>() : INVALID_BLOCK_NUM;
+             chain.export_snapshot( fc::path( params[0].as_string() ), block_num );
+             return fc::variant( true );
+         });
+
          con->add_method( "getinfo", [=]( const fc::variants& params ) -> fc::variant 
          {
              fc::mutable_variant_object info; 
@@ -681,6 +690,7 @@ void print_help()
     std::cout<<" cancel ID IDX  \n";
     std::cout<<" html FILE\n";
     std::cout<<" json FILE\n";
+    std::cout<<" snapshot FILE [BLOCK_NUM]  -  export the chain state, at the head block by default\n";
     std::cout<<" market QUOTE BASE  \n";
     std::cout<<" show orders QUOTE BASE  \n";
 }
@@ -743,6 +753,13 @@ void process_commands( fc::thread* main_thread, std::shared_ptr<client> c )
             ss >> file;
             main_thread->async( [=](){ c->dump_chain_json(file); } ).wait();
          }
+         else if( command == "snapshot" )
+         {
+            std::string file;
+            uint32_t    block_num = INVALID_BLOCK_NUM;
+            ss >> file >> block_num;
+            main_thread->async( [=](){ c->chain.export_snapshot( fc::path( file ), block_num ); } ).wait();
+         }
          else if( command == "c" || command == "cancel" )
          {
             std::string id;
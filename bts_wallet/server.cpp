@@ -1,12 +1,34 @@
 #include "chain_server.hpp"
+#include <bts/blockchain/blockchain_db.hpp>
 #include <fc/thread/thread.hpp>
+#include <fc/filesystem.hpp>
 
 int main( int argc, char** argv )
 {
    try {
+       if( argc > 2 && std::string( argv[1] ) == "--export-snapshot" )
+       {
+          // --export-snapshot FILE [BLOCK_NUM]
+          bts::blockchain::blockchain_db chain;
+          chain.open( "chain", false );
+          chain.export_snapshot( fc::path( argv[2] ), argc > 3 ? std::stoul( argv[3] ) : INVALID_BLOCK_NUM );
+          return 0;
+       }
+       if( argc > 2 && std::string( argv[1] ) == "--import-snapshot" )
+       {
+          // the chain is closed again before the server opens it
+          bts::blockchain::blockchain_db chain;
+          chain.open( "chain" );
+          chain.import_snapshot( fc::path( argv[2] ) );
+       }
+
        chain_server cserv;
        chain_server::config cfg;
        cfg.port = 4567;
+       if( argc > 2 && std::string( argv[1] ) == "--prune" )
+       {
+          cfg.prune_depth = std::stoul( argv[2] );
+       }
        cserv.configure(cfg);
        fc::usleep( fc::seconds( 60*60*24*365 ) );
    } 
@@ -1,6 +1,7 @@
 #pragma once
 #include <bts/bitchat/bitchat_private_message.hpp>
 #include <fc/filesystem.hpp>
+#include <fc/optional.hpp>
 
 namespace bts { namespace bitchat {
 
@@ -21,6 +22,9 @@ namespace bts { namespace bitchat {
        void                     cache( const encrypted_message& msg );
        std::vector<fc::uint128> get_inventory( const fc::time_point& start_time, const fc::time_point& end_time );
        encrypted_message        fetch( const fc::uint128& msg_id );
+       /** @return null if msg_id is not cached, without throwing */
+       fc::optional<encrypted_message> try_fetch( const fc::uint128& msg_id );
+       bool                     contains( const fc::uint128& msg_id );
 
        fc::time_point           last_message_timestamp();
 
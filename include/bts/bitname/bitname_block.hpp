@@ -3,6 +3,7 @@
 #include <fc/optional.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/crypto/sha224.hpp>
+#include <bts/memoized_id.hpp>
 
 namespace bts { namespace bitname { struct name_trx; }}
 
@@ -141,9 +142,14 @@ namespace bts { namespace bitname {
        :name_trx(b),prev(previous_block){}
 
        uint64_t   difficulty()const;
+       /** computed on first use, call reset_id() after modifying the header */
        name_id_type       id()const;
        short_name_id_type short_id()const;
+       void               reset_id();
        name_id_type       prev;    ///< previous block
+
+      private:
+       memoized_id<name_id_type> _id;
     };
 
     
@@ -1,6 +1,7 @@
 #pragma once
 #include <bts/bitname/bitname_block.hpp>
 #include <fc/filesystem.hpp>
+#include <fc/optional.hpp>
 
 namespace bts { namespace bitname {
 
@@ -57,6 +58,8 @@ namespace bts { namespace bitname {
 
         /** fetches the most recent registration of name_hash */
         name_trx        fetch_trx( uint64_t name_hash )const;
+        /** like fetch_trx() but returns null for a name that was never registered */
+        fc::optional<name_trx> try_fetch_trx( uint64_t name_hash )const;
         uint32_t        fetch_repute( uint64_t name_hash )const;
 
         /** get a block by its block_id */
@@ -0,0 +1,41 @@
+#pragma once
+#include <bts/address.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <vector>
+
+namespace bts { namespace blockchain {
+
+  /**
+   *  A bloom filter over the addresses referenced by a block, stored next to
+   *  the block so that a wallet can rule out blocks that cannot involve its
+   *  keys without loading their transactions.
+   *
+   *  Addresses are already hashes, so the bit positions are derived from the
+   *  address bytes directly.  may_contain() never misses an inserted address
+   *  and reports a false positive for roughly 1% of other addresses.
+   */
+  struct address_filter
+  {
+     address_filter(){}
+
+     /** sizes the filter for expected_count addresses */
+     explicit address_filter( uint32_t expected_count );
+
+     void insert( const address& a );
+     bool may_contain( const address& a )const;
+
+     /** @return true if any of addrs may be in the filter */
+     template<typename Container>
+     bool may_contain_any( const Container& addrs )const
+     {
+        for( auto itr = addrs.begin(); itr != addrs.end(); ++itr )
+           if( may_contain( *itr ) ) return true;
+        return false;
+     }
+
+     std::vector<char> bits;
+  };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::address_filter, (bits) )
@@ -1,5 +1,6 @@
 #pragma once
 #include <bts/small_hash.hpp>
+#include <bts/memoized_id.hpp>
 #include <bts/blockchain/proof.hpp>
 #include <bts/blockchain/transaction.hpp>
 #include <bts/blockchain/asset.hpp>
@@ -21,7 +22,9 @@ namespace bts { namespace blockchain {
       block_header()
       :version(0),block_num(-1),total_shares(0),total_coindays_destroyed(0){}
 
+      /** computed on first use, call reset_id() after modifying the header */
       block_id_type id()const;
+      void          reset_id();
 
       fc::unsigned_int    version;
       block_id_type       prev;
@@ -30,6 +33,9 @@ namespace bts { namespace blockchain {
       uint64_t            total_shares; 
       uint64_t            total_coindays_destroyed; ///< cumulative for entire chain
       uint160             trx_mroot;   ///< merkle root of trx included in block, required for light client validation
+
+     private:
+      memoized_id<block_id_type> _id;
    };
 
    /**
@@ -66,6 +72,12 @@ namespace bts { namespace blockchain {
    
    trx_block create_genesis_block();
 
+   /**
+    *  @return true if branch proves that trx_id is one of the trxs of header,
+    *          which lets a light client confirm a trx with only the headers
+    */
+   bool verify_trx_branch( const block_header& header, const transaction_id_type& trx_id, const merkle_branch& branch );
+
 } } // bts::blockchain
 
 namespace fc 
@@ -0,0 +1,61 @@
+#pragma once
+#include <bts/blockchain/block.hpp>
+#include <fc/filesystem.hpp>
+
+namespace bts { namespace blockchain {
+
+  namespace detail { class block_archive_impl; }
+
+  /**
+   *  Append only store for blocks that are buried too deep to be popped.
+   *
+   *  Blocks are packed one after another into blocks.dat and the offset of
+   *  each block is appended to blocks.idx, so block n starts at entry n of
+   *  the index.  The data file is mapped read only and blocks are unpacked
+   *  straight from the mapping.
+   *
+   *  The archive is a read cache, every block it holds is also kept in the
+   *  chain database so it can be deleted and rebuilt at any time.
+   *
+   *  The block data is synced before its index entries are written, so an
+   *  index entry never points at data that a crash could lose.  open()
+   *  drops index entries past the data and data past the last entry.
+   */
+  class block_archive
+  {
+     public:
+       block_archive();
+       ~block_archive();
+
+       void open( const fc::path& dir );
+       void close();
+
+       /** @return the number of archived blocks, block_num of the next append */
+       uint32_t  size()const;
+
+       /** @pre b.block_num == size() */
+       void      append( const trx_block& b );
+
+       /**
+        *  Appends consecutive blocks with one sync of the data file.
+        *
+        *  @pre blocks.front().block_num == size()
+        */
+       void      append( const std::vector<trx_block>& blocks );
+
+       /** removes every block starting at block_num */
+       void      truncate( uint32_t block_num );
+
+       trx_block fetch( uint32_t block_num )const;
+
+       /**
+        *  @return the packed block, pointing into the mapped file.  The pointer
+        *          stays valid until the next append() or truncate().
+        */
+       std::pair<const char*,size_t> fetch_packed( uint32_t block_num )const;
+
+     private:
+       std::unique_ptr<detail::block_archive_impl> my;
+  };
+
+} } // bts::blockchain
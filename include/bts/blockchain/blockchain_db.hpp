@@ -1,6 +1,12 @@
 #pragma once
 #include <bts/blockchain/block.hpp>
 #include <bts/blockchain/transaction.hpp>
+#include <bts/blockchain/signature_cache.hpp>
+#include <bts/blockchain/address_filter.hpp>
+#include <bts/db/value_cache.hpp>
+#include <fc/optional.hpp>
+
+#include <map>
 
 namespace fc 
 {
@@ -29,6 +35,16 @@ namespace bts { namespace blockchain {
        }
     };
 
+    /**
+     *  A transaction along with the result of evaluating it against
+     *  the head block.
+     */
+    struct evaluated_trx
+    {
+       signed_transaction trx;
+       trx_eval           eval;
+    };
+
     struct trx_num
     {
       /** 
@@ -83,6 +99,46 @@ namespace bts { namespace blockchain {
        meta_trx_output   meta_output;
     };
 
+    /**
+     *  Compact record kept for every unspent output so that inputs can be
+     *  resolved without loading the transaction that created the output.
+     */
+    struct unspent_output
+    {
+       unspent_output(){}
+       unspent_output( const trx_output& o, const trx_num& s )
+       :output(o),source(s){}
+
+       trx_output        output;
+       trx_num           source; ///< the transaction that created output
+    };
+
+    /**
+     *  Key of the address index, orders the outputs paid to an address by the
+     *  position of the transaction that created them.
+     */
+    struct address_output_key
+    {
+       address_output_key():output_idx(0){}
+       address_output_key( const address& a, const trx_num& s, uint8_t o )
+       :owner(a),source(s),output_idx(o){}
+
+       address   owner;
+       trx_num   source;
+       uint8_t   output_idx;
+
+       friend bool operator < ( const address_output_key& a, const address_output_key& b )
+       {
+          if( a.owner != b.owner )   return a.owner < b.owner;
+          if( !(a.source == b.source) ) return a.source < b.source;
+          return a.output_idx < b.output_idx;
+       }
+       friend bool operator == ( const address_output_key& a, const address_output_key& b )
+       {
+          return a.owner == b.owner && a.source == b.source && a.output_idx == b.output_idx;
+       }
+    };
+
     struct meta_trx : public signed_transaction
     {
        meta_trx(){}
@@ -152,6 +208,66 @@ namespace bts { namespace blockchain {
           void open( const fc::path& dir, bool create = true );
           void close();
 
+          /**
+           *  Deletes every transaction whose outputs are all spent once the block 
+           *  of its last spend is depth blocks below the head.  Headers and unspent
+           *  outputs are kept, but the transactions of blocks below depth can no
+           *  longer be fetched.
+           *
+           *  The block archive is deleted and no longer kept, it is a copy of
+           *  the full blocks that pruning removes.
+           *
+           *  @pre depth >= BITSHARE_MAX_UNDO_BLOCKS so that popped blocks can be
+           *       rolled back.
+           */
+          void enable_pruning( uint32_t depth );
+
+          /**
+           *  Blocks less than BITSHARE_MAX_UNDO_BLOCKS below the next checkpoint
+           *  are validated without recovering the signatures of their trxs,
+           *  everything else is still checked.  A block at a checkpoint height
+           *  with a different id is rejected, the checkpoints are no longer
+           *  trusted and the blocks that were accepted on trust are popped and
+           *  validated again.  open() starts without any checkpoints.
+           */
+          void add_checkpoint( uint32_t block_num, const block_id_type& id );
+
+          /**
+           *  Maintains an index from the address that owns each output (signature
+           *  owner, bid and long pay address, cover owner) to the output as blocks
+           *  are pushed and popped.  The index is rebuilt from the stored trxs if
+           *  it was not maintained for every block, pruned trxs are not included.
+           */
+          void enable_address_index();
+
+          /**
+           *  Writes the header of block_num, every transaction that had an
+           *  unspent output as of block_num and the transactions of block_num
+           *  to file, followed by a checksum.
+           *
+           *  @param block_num - the head of the snapshot, the head block if invalid
+           *  @pre   block_num has not been pruned
+           */
+          void export_snapshot( const fc::path& file, uint32_t block_num = INVALID_BLOCK_NUM );
+
+          /**
+           *  Brings an empty chain to the head of the snapshot in file, the 
+           *  unspent outputs and market are rebuilt from its transactions.  
+           *  Blocks are pushed on top of the snapshot head as usual but the blocks
+           *  below it can not be fetched and the head can not be popped.
+           *
+           *  The snapshot has no undo records, so only the blocks pushed after
+           *  the import can be popped.  A fork that branches at or below the
+           *  snapshot head can not be switched to, import a snapshot that is
+           *  at least BITSHARE_MAX_UNDO_BLOCKS below the head of the network.
+           *
+           *  The checksum, the transactions of the head block against its
+           *  trx_mroot and the head against any checkpoint at its height are
+           *  checked first.  The chain is built in a separate directory that
+           *  replaces this one once it is complete.
+           */
+          void import_snapshot( const fc::path& file );
+
           uint32_t      head_block_num()const;
           block_id_type head_block_id()const;
           uint64_t      get_stake(); // head - 1 
@@ -168,22 +284,104 @@ namespace bts { namespace blockchain {
           *  @throw exception if trx can not be applied to the current chain state.
           */
          trx_eval   evaluate_signed_transaction( const signed_transaction& trx );       
+         trx_eval   evaluate_signed_transaction( const signed_transaction& trx, const std::unordered_set<address>& signers );
          trx_eval   evaluate_signed_transactions( const std::vector<signed_transaction>& trxs );
 
+         /**
+          *  Recovers the addresses that signed each of trxs, spreading the work
+          *  across a pool of worker threads.  A trx whose signatures cannot be 
+          *  recovered gets an empty set so that evaluating it repeats the 
+          *  recovery and reports the error.
+          */
+         std::vector< std::unordered_set<address> > recover_signers( const std::vector<signed_transaction>& trxs );
+
+         /**
+          *  @return the addresses that signed trx, served from the signature cache
+          *          when trx has been seen before.
+          */
+         std::unordered_set<address>                 get_signers( const signed_transaction& trx );
+         signature_cache::stats                      get_signature_cache_stats()const;
+         /** @return the decoded value cache counters of each cached table, by table name */
+         std::map<std::string,bts::db::cache_stats>  get_db_cache_stats()const;
+
          std::vector<signed_transaction> match_orders();
+
+         /**
+          *  Evaluates every trx, orders them by fee and builds the next block 
+          *  from the ones that are valid.
+          */
          trx_block  generate_next_block( const std::vector<signed_transaction>& trx );
 
+         /**
+          *  Builds the next block from trxs that were already evaluated against 
+          *  the head block and are in the order they should be included.  Only 
+          *  the trxs generated by match_orders() are evaluated, they are placed 
+          *  first and any trx that spends the same output as an earlier one is 
+          *  skipped.
+          */
+         trx_block  generate_next_block( const std::vector<evaluated_trx>& trxs );
+
          trx_num    fetch_trx_num( const uint160& trx_id );
+         /** @return null if trx_id is not in the chain, without throwing */
+         fc::optional<trx_num> try_fetch_trx_num( const uint160& trx_id );
          meta_trx   fetch_trx( const trx_num& t );
 
          signed_transaction          fetch_transaction( const transaction_id_type& trx_id );
          std::vector<meta_trx_input> fetch_inputs( const std::vector<trx_input>& inputs, uint32_t head = INVALID_BLOCK_NUM );
 
+         /**
+          *  @return the output referenced by ref if it exists and is unspent as of
+          *          the head block, served from memory.
+          */
+         fc::optional<unspent_output> fetch_unspent( const output_reference& ref )const;
+
+         /**
+          *  @return every output paid to owner, in chain order
+          *  @pre    enable_address_index()
+          */
+         std::vector<output_reference>                                fetch_address_history( const address& owner );
+
+         /**
+          *  @return the outputs paid to owner that are unspent as of the head block
+          *  @pre    enable_address_index()
+          */
+         std::vector< std::pair<output_reference,unspent_output> >    fetch_address_unspent( const address& owner );
+
          uint32_t     fetch_block_num( const block_id_type& block_id );
+         /** @return null if block_id is not in the chain, without throwing */
+         fc::optional<uint32_t> try_fetch_block_num( const block_id_type& block_id );
          block_header fetch_block( uint32_t block_num );
          full_block   fetch_full_block( uint32_t block_num );
          trx_block    fetch_trx_block( uint32_t block_num );
 
+         /**
+          *  @return the transactions of block_num in block order, read with a
+          *          single scan because meta_trxs keys sort by block then index.
+          *  @throw  if block_num has been pruned
+          */
+         std::vector<meta_trx> fetch_block_trxs( uint32_t block_num );
+
+         /**
+          *  @return the merkle branch from trx_id to the trx_mroot of the block
+          *          that includes it
+          *  @see    verify_trx_branch()
+          */
+         merkle_branch fetch_trx_branch( const transaction_id_type& trx_id );
+
+         /**
+          *  @return the filter over the addresses referenced by the outputs and
+          *          spent inputs of block_num, null for blocks stored without one
+          */
+         fc::optional<address_filter> fetch_address_filter( uint32_t block_num );
+
+         /**
+          *  @return the blocks from from_block_num to to_block_num, or the head if
+          *          it is lower, that may reference one of addrs, including
+          *          every block stored without a filter
+          */
+         std::vector<uint32_t> match_address_filters( const std::vector<address>& addrs, uint32_t from_block_num = 0,
+                                                      uint32_t to_block_num = INVALID_BLOCK_NUM );
+
          uint64_t   current_bitshare_supply();
          
          /**
@@ -193,16 +391,34 @@ namespace bts { namespace blockchain {
 
          /**
           *  Removes the top block from the stack and marks all spent outputs as 
-          *  unspent.
+          *  unspent.  Only the last BITSHARE_MAX_UNDO_BLOCKS blocks can be popped.
+          *
+          *  @param b    - set to the block that was removed
+          *  @param trxs - set to the transactions of the block that was removed
           */
          void pop_block( full_block& b, std::vector<signed_transaction>& trxs );
 
+         /**
+          *  Pops blocks until fork.front() can be pushed and then pushes every 
+          *  block of fork.  The links and merkle roots of fork are checked before
+          *  anything is popped.  The replaced blocks are journaled first, so if
+          *  any fork block is invalid the exact prior chain is restored and the
+          *  error is rethrown, and if the switch is interrupted open() restores it.
+          *
+          *  @return the blocks that were popped, in chain order
+          */
+         std::vector<trx_block> switch_to_fork( const std::vector<trx_block>& fork );
+
          std::string dump_market( asset::type quote, asset::type base );
 
          market_data get_market( asset::type quote, asset::type base );
 
        private:
-         void   store_trx( const signed_transaction& trx, const trx_num& t );
+         void     store_trx( const signed_transaction& trx, const trx_num& t );
+         trx_eval evaluate( const signed_transaction& trx, const std::unordered_set<address>& signers, bool trust_signatures );
+         trx_eval evaluate_trusted_transactions( const std::vector<signed_transaction>& trxs );
+         void     restore_fork_journal();
+         void     revalidate_trusted_blocks( uint32_t mismatch_num );
          std::unique_ptr<detail::blockchain_db_impl> my;          
     };
 
@@ -211,9 +427,12 @@ namespace bts { namespace blockchain {
 }  } // bts::blockchain
 
 FC_REFLECT( bts::blockchain::trx_eval, (fees)(coindays_destroyed) )
+FC_REFLECT( bts::blockchain::evaluated_trx, (trx)(eval) )
 FC_REFLECT( bts::blockchain::trx_num, (block_num)(trx_idx) );
 FC_REFLECT( bts::blockchain::meta_trx_output, (trx_id)(input_num) )
 FC_REFLECT( bts::blockchain::meta_trx_input, (source)(output_num)(output)(meta_output) )
+FC_REFLECT( bts::blockchain::unspent_output, (output)(source) )
+FC_REFLECT( bts::blockchain::address_output_key, (owner)(source)(output_idx) )
 FC_REFLECT_DERIVED( bts::blockchain::meta_trx, (bts::blockchain::signed_transaction), (meta_outputs) );
 FC_REFLECT( bts::blockchain::bid_data, (bid_price)(amount)(is_short) )
 FC_REFLECT( bts::blockchain::ask_data, (ask_price)(amount) )
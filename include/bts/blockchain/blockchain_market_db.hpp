@@ -1,9 +1,12 @@
 #pragma once
 #include <bts/blockchain/block.hpp>
 #include <bts/blockchain/asset.hpp>
+#include <bts/blockchain/outputs.hpp>
 #include <fc/optional.hpp>
 #include <fc/filesystem.hpp>
 
+#include <map>
+
 namespace bts { namespace blockchain {
 
   namespace detail { class market_db_impl; }
@@ -29,30 +32,91 @@ namespace bts { namespace blockchain {
   };
   bool operator < ( const market_order& a, const market_order& b );
   bool operator == ( const market_order& a, const market_order& b );
+
+  /**
+   *  The terms of the claim_by_bid or claim_by_long output that placed an order, 
+   *  stored with the order so that the book can be walked without fetching the 
+   *  transaction that created each output.
+   */
+  struct order_terms
+  {
+     order_terms():amount(0),claim_func(null_claim_type),min_trade(0){}
+     order_terms( const trx_output& out );
+
+     /** @return the output these terms were taken from */
+     trx_output get_output()const;
+
+     uint64_t          amount;
+     asset_type        unit;
+     uint8_t           claim_func;
+     address           pay_address;
+     price             ask_price;
+     uint64_t          min_trade;
+  };
   
   /**
    *  Manages the current state of the market to enable effecient
    *  pairing of the highest bid with the lowest ask.
+   *
+   *  Every order is kept in an in memory book per quote/base pair that is
+   *  loaded from the bids and asks databases on open and updated along with
+   *  them, so reading the market never touches the databases.
    */
   class market_db
   {
      public:
+       /** one side of a book ordered by price from low to high */
+       typedef std::map<market_order,order_terms> order_set;
+
        market_db();
        ~market_db();
 
        void open( const fc::path& db_dir );
+       void close();
+
+       /**
+        *  @return true if open() found orders stored without their terms, the
+        *          orders were discarded and have to be placed again.
+        */
+       bool needs_reindex()const;
        std::vector<market_order> get_bids( asset::type quote_unit, asset::type base_unit )const;
        std::vector<market_order> get_asks( asset::type quote_unit, asset::type base_unit )const;
 
-       void insert_bid( const market_order& m );
-       void insert_ask( const market_order& m );
+       /**
+        *  @return the bids or asks for the pair so that they can be walked from
+        *          the best price without copying the book.  The reference
+        *          stays valid until the next commit or unbatched change.
+        */
+       const order_set& get_bid_book( asset::type quote_unit, asset::type base_unit )const;
+       const order_set& get_ask_book( asset::type quote_unit, asset::type base_unit )const;
+
+       void insert_bid( const market_order& m, const order_terms& t );
+       void insert_ask( const market_order& m, const order_terms& t );
        void remove_bid( const market_order& m );
        void remove_ask( const market_order& m );
 
+       /**
+        *  Queues all following inserts and removes until commit_batch() writes
+        *  them to the bids and asks tables in one batch each, the books are
+        *  updated by commit_batch() so queued changes are not visible.
+        */
+       void start_batch();
+       void commit_batch( bool sync = false );
+
+       /**
+        *  A pair is dirty from the time an order is placed or removed from its
+        *  book until mark_clean() is called for it, every pair with orders is
+        *  dirty after open().
+        *
+        *  @return the (quote,base) pairs that are dirty, ordered by base then quote
+        */
+       std::vector< std::pair<asset::type,asset::type> > get_dirty_pairs()const;
+       void                                              mark_clean( asset::type quote, asset::type base );
+
        /** @pre quote > base  */
-       fc::optional<market_order> get_highest_bid( asset::type quote, asset::type base );
+       fc::optional<market_order> get_highest_bid( asset::type quote, asset::type base )const;
        /** @pre quote > base  */
-       fc::optional<market_order> get_lowest_ask( asset::type quote, asset::type base );
+       fc::optional<market_order> get_lowest_ask( asset::type quote, asset::type base )const;
 
      private:
        std::unique_ptr<detail::market_db_impl> my;
@@ -61,3 +125,4 @@ namespace bts { namespace blockchain {
 } }  // bts::blockchain
 
 FC_REFLECT( bts::blockchain::market_order, (base_unit)(quote_unit)(ratio)(location) );
+FC_REFLECT( bts::blockchain::order_terms, (amount)(unit)(claim_func)(pay_address)(ask_price)(min_trade) );
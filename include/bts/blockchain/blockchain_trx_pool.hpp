@@ -0,0 +1,65 @@
+#pragma once
+#include <bts/blockchain/blockchain_db.hpp>
+#include <bts/config.hpp>
+
+namespace bts { namespace blockchain {
+
+  namespace detail { class trx_pool_impl; }
+
+  /**
+   *  Holds the transactions waiting to be included in a block.
+   *
+   *  Each trx is evaluated once when it is added and then indexed by fee rate
+   *  (fees per packed byte times BITSHARE_FEE_RATE_SCALE), by the outputs it
+   *  spends and by the time it expires.
+   *  No two trx in the pool spend the same output, so the highest paying
+   *  trx can be taken in order to fill a block without checking for conflicts.
+   */
+  class trx_pool
+  {
+     public:
+       trx_pool( blockchain_db& chain, uint32_t max_size = BITSHARE_MAX_PENDING_TRXS );
+       ~trx_pool();
+
+       /**
+        *  Evaluates trx against the head block and adds it to the pool.  A trx
+        *  that spends an output already spent by pending trxs replaces them only
+        *  if it pays a higher fee rate than all of them.
+        *
+        *  @throw if trx is invalid, already pending, or loses to a conflicting trx
+        */
+       trx_eval add( const signed_transaction& trx );
+       void     remove( const transaction_id_type& trx_id );
+       bool     contains( const transaction_id_type& trx_id )const;
+       size_t   size()const;
+
+       /**
+        *  Removes the trxs included in b and every pending trx that spends an
+        *  output spent by b.  Call after b is pushed.
+        */
+       void     block_pushed( const trx_block& b );
+
+       /**
+        *  Removes pending trxs that spend outputs created by the popped block
+        *  and tries to add the popped trxs back.  Call after the block is popped.
+        */
+       void     block_popped( const std::vector<signed_transaction>& trxs );
+
+       /** removes every trx whose valid_until is before now */
+       void     remove_expired( const fc::time_point_sec& now );
+
+       /**
+        *  Drops every pending trx that spends an output which is no longer
+        *  unspent, in case the pool missed a block_pushed() call.
+        *
+        *  @return the pending trxs with the highest fee rate whose packed size
+        *          sums to at most max_bytes, best first.
+        */
+       std::vector<evaluated_trx>      select( size_t max_bytes = MAX_BLOCK_TRXS_SIZE );
+       std::vector<signed_transaction> get_pending()const;
+
+     private:
+       std::unique_ptr<detail::trx_pool_impl> my;
+  };
+
+} } // bts::blockchain
@@ -0,0 +1,42 @@
+#pragma once
+#include <bts/blockchain/blockchain_db.hpp>
+#include <fc/filesystem.hpp>
+
+namespace bts { namespace blockchain {
+
+  namespace detail { class unspent_db_impl; }
+
+  /**
+   *  Tracks every unspent output on the chain.  The full set is held in memory
+   *  and mirrored to a database so that it survives restarts without replaying
+   *  the chain.
+   */
+  class unspent_db
+  {
+     public:
+       unspent_db();
+       ~unspent_db();
+
+       void open( const fc::path& db_dir );
+       void close();
+
+       /** @return nullptr if ref is not an unspent output */
+       const unspent_output* find( const output_reference& ref )const;
+       size_t                size()const;
+
+       void insert( const output_reference& ref, const unspent_output& out );
+       void remove( const output_reference& ref );
+
+       /**
+        *  Queues all following inserts and removes until commit_batch() writes
+        *  them in one batch, the in memory set is updated by commit_batch() so
+        *  find() does not see queued changes.
+        */
+       void start_batch();
+       void commit_batch( bool sync = false );
+
+     private:
+       std::unique_ptr<detail::unspent_db_impl> my;
+  };
+
+} } // bts::blockchain
@@ -0,0 +1,52 @@
+#pragma once
+#include <bts/blockchain/transaction.hpp>
+#include <bts/config.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <unordered_set>
+
+namespace bts { namespace blockchain {
+
+  namespace detail { class signature_cache_impl; }
+
+  /**
+   *  Remembers the addresses recovered from the signatures of recently seen
+   *  transactions so that a trx evaluated on arrival, again while generating a
+   *  block and again when the block is pushed only pays for recovery once.
+   *
+   *  Entries are keyed by trx id, which covers the signatures as well as the
+   *  signed digest, and the least recently used entry is evicted once the 
+   *  cache is full.  All methods are safe to call from multiple threads.
+   */
+  class signature_cache
+  {
+     public:
+       struct stats
+       {
+          stats():hits(0),misses(0),evictions(0),size(0),capacity(0){}
+          uint64_t hits;
+          uint64_t misses;
+          uint64_t evictions;
+          uint32_t size;
+          uint32_t capacity;
+       };
+
+       signature_cache( uint32_t capacity = BITSHARE_SIGNATURE_CACHE_SIZE );
+       ~signature_cache();
+
+       /**
+        *  @return the addresses that signed trx, recovering them on a miss
+        *  @throw  if the signatures cannot be recovered, failures are not cached
+        */
+       std::unordered_set<address> get_signers( const signed_transaction& trx );
+
+       void  set_capacity( uint32_t capacity );
+       stats get_stats()const;
+
+     private:
+       std::unique_ptr<detail::signature_cache_impl> my;
+  };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::signature_cache::stats, (hits)(misses)(evictions)(size)(capacity) )
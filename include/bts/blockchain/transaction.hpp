@@ -4,6 +4,7 @@
 #include <bts/units.hpp>
 #include <bts/address.hpp>
 #include <bts/proof_of_work.hpp>
+#include <bts/memoized_id.hpp>
 #include <fc/crypto/elliptic.hpp>
 #include <fc/crypto/sha224.hpp>
 #include <fc/io/varint.hpp>
@@ -138,10 +139,16 @@ struct transaction
 struct signed_transaction : public transaction
 {
     std::unordered_set<address>      get_signed_addresses()const;
+
+    /** computed on first use, call reset_id() after modifying the trx */
     transaction_id_type              id()const;
+    void                             reset_id();
     void                             sign( const fc::ecc::private_key& k );
 
     std::set<fc::ecc::compact_signature> sigs;
+
+  private:
+    memoized_id<transaction_id_type> _id;
 };
 
 } }  // namespace bts::blockchain
@@ -31,7 +31,19 @@ namespace bts { namespace blockchain {
                                 uint32_t  head_idx = -1
                                 );
 
-           trx_validation_state() : trx(signed_transaction()) {}
+           /**
+            * @param signers - the addresses that signed t, recovered ahead of time
+            * by blockchain_db::recover_signers() so that the cost of recovery can
+            * be spread across threads.
+            */
+           trx_validation_state( const signed_transaction& t, 
+                                const std::unordered_set<address>& signers,
+                                blockchain_db* d, 
+                                bool enforce_unspent_in = true,
+                                uint32_t  head_idx = -1
+                                );
+
+           trx_validation_state() : trx(signed_transaction()),trust_signatures(false) {}
            
            /** tracks the sum of all inputs and outputs for a particular
             * asset type in the balance_sheet 
@@ -106,15 +118,26 @@ namespace bts { namespace blockchain {
 
            bool                                enforce_unspent;
            uint32_t                            ref_head;
+
+           /**
+            *  Set for trx in blocks below a trusted checkpoint, signatures are only
+            *  recovered for trxs that spend a bid or long, every other required
+            *  signature is taken to be present if the trx is signed at all.
+            */
+           bool                                trust_signatures;
+
            /** @throw an exception on error */
            void validate();
         private:
+           void init_balance_sheet();
            static const uint16_t output_not_found = uint16_t(-1);
            void     mark_output_as_used( uint16_t output_number );
            uint16_t find_unused_sig_output( const address& a, const asset& bal );
            uint16_t find_unused_bid_output( const claim_by_bid_output& b );
            uint16_t find_unused_long_output( const claim_by_long_output& b );
            uint16_t find_unused_cover_output( const claim_by_cover_output& b, uint64_t min_collat );
+           bool     is_signed_by( const address& a )const;
+           void     load_signers();
 
            void validate_input( const meta_trx_input& );
            void validate_signature( const meta_trx_input& );
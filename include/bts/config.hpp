@@ -62,6 +62,19 @@
 // blockchain channel config
 #define TRX_INV_QUERY_LIMIT           (2000) // number of trx that may be sent as part of inventory or request msg
 #define BLOCK_INV_QUERY_LIMIT         (2000) // number of trx that may be sent as part of inventory or request msg
+#define BITSHARE_MIN_TRXS_PER_RECOVERY_THREAD (4) // smallest share of a block handed to a signature recovery thread
+#define BITSHARE_SIGNATURE_CACHE_SIZE (64*1024) // number of trx whose recovered signers are remembered
+#define BITSHARE_MAX_UNDO_BLOCKS      (1024) // deepest chain reorganization that can be performed
+#define BITSHARE_SYNC_INTERVAL        (64) // blocks between syncs of every chain table, open() replays the blocks since
+#define BITSHARE_MAX_PENDING_TRXS     (10000) // trx held in the pool waiting for a block
+#define BITSHARE_FEE_RATE_SCALE       (1024) // pool fee rates are fees per byte times this, keeps the fraction
+#define BITSHARE_PRUNE_COMPACT_INTERVAL (1000) // blocks pruned between compactions of the pruned key range
+#define BITSHARE_ADDRESS_FILTER_BITS_PER_ADDRESS (10) // bloom filter size per address referenced by a block
+#define BITSHARE_ADDRESS_FILTER_HASHES (7) // bits set per address, ~1% false positives at 10 bits per address
+#define BITSHARE_MAX_FILTER_ADDRESSES (1000) // addresses a client may match against the address filters per request
+#define BITSHARE_MAX_FILTER_BLOCKS    (10000) // blocks whose address filters are matched per client request
+#define BITSHARE_TRX_CACHE_SIZE       (16*1024) // decoded meta_trxs and trx_id2num entries kept in memory
+#define BITSHARE_BLOCK_HEADER_CACHE_SIZE (1024) // decoded block headers kept in memory
 
 
 /**
@@ -76,3 +89,9 @@
 #define BITNAME_TIME_TOLLERANCE_SEC        (60*60) // 60 minutes
 #define BITNAME_BLOCKS_BEFORE_TRANSFER     (288*7) // 1 week before a transfer is complete 
 #define BITNAME_BLOCKS_PER_YEAR            (288*365)
+#define BITNAME_RECORD_CACHE_SIZE          (4096)  // decoded name locations and headers kept in memory
+
+#define BTS_DB_BLOCK_CACHE_SIZE            (64*1024*1024) // LevelDB block cache shared by every database
+#define BTS_DB_BLOOM_BITS_PER_KEY          (10)           // ~1% false positives on point lookup databases
+#define BTS_DB_SCAN_BLOCK_SIZE             (64*1024)      // LevelDB block size of databases that are mostly scanned
+#define BTS_DB_WRITE_BUFFER_SIZE           (16*1024*1024) // memtable size of databases that take large batches
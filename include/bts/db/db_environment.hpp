@@ -0,0 +1,103 @@
+#pragma once
+#include <leveldb/options.h>
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+
+#include <fc/thread/mutex.hpp>
+#include <fc/thread/scoped_lock.hpp>
+
+#include <bts/config.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace bts { namespace db {
+
+  namespace ldb = leveldb;
+
+  /**
+   *  Describes how a database is used so that it can be opened with suitable
+   *  LevelDB options.  Every profile shares the process wide block cache.
+   */
+  enum db_profile
+  {
+     default_profile,       ///< LevelDB defaults
+     point_lookup_profile,  ///< random gets that often miss, adds a bloom filter
+     scan_profile,          ///< mostly iterated in key order, uses larger blocks
+     write_heavy_profile    ///< frequent large batches, uses a larger write buffer
+  };
+
+  /**
+   *  Process wide LevelDB settings shared by every level_map and level_pod_map
+   *  so that all databases draw from one block cache instead of each keeping
+   *  its own small default cache.
+   */
+  class db_environment
+  {
+     public:
+        /**
+         *  The environment is never destroyed because open databases keep
+         *  pointers to its cache and filter policy until they are closed.
+         */
+        static db_environment& instance()
+        {
+           static db_environment* env = new db_environment();
+           return *env;
+        }
+
+        /**
+         *  Replaces the shared block cache, only databases opened afterward use
+         *  the new one.  The old cache is kept alive for databases still using it.
+         */
+        void set_block_cache_size( size_t bytes )
+        {
+           fc::scoped_lock<fc::mutex> lock( _lock );
+           if( bytes == _block_cache_size ) return;
+           _retired_caches.push_back( std::move( _block_cache ) );
+           _block_cache.reset( ldb::NewLRUCache( bytes ) );
+           _block_cache_size = bytes;
+        }
+
+        size_t get_block_cache_size()const
+        {
+           fc::scoped_lock<fc::mutex> lock( _lock );
+           return _block_cache_size;
+        }
+
+        ldb::Options options( db_profile profile )
+        {
+           fc::scoped_lock<fc::mutex> lock( _lock );
+           ldb::Options opts;
+           opts.block_cache = _block_cache.get();
+           switch( profile )
+           {
+              case point_lookup_profile:
+                 opts.filter_policy = _bloom_filter.get();
+                 break;
+              case scan_profile:
+                 opts.block_size = BTS_DB_SCAN_BLOCK_SIZE;
+                 break;
+              case write_heavy_profile:
+                 opts.write_buffer_size = BTS_DB_WRITE_BUFFER_SIZE;
+                 break;
+              case default_profile:
+                 break;
+           }
+           return opts;
+        }
+
+     private:
+        db_environment()
+        :_block_cache( ldb::NewLRUCache( BTS_DB_BLOCK_CACHE_SIZE ) ),
+         _block_cache_size( BTS_DB_BLOCK_CACHE_SIZE ),
+         _bloom_filter( ldb::NewBloomFilterPolicy( BTS_DB_BLOOM_BITS_PER_KEY ) )
+        {}
+
+        std::unique_ptr<ldb::Cache>                 _block_cache;
+        size_t                                      _block_cache_size;
+        std::vector< std::unique_ptr<ldb::Cache> >  _retired_caches;
+        std::unique_ptr<const ldb::FilterPolicy>    _bloom_filter;
+        mutable fc::mutex                           _lock;
+  };
+
+} } // bts::db
@@ -0,0 +1,289 @@
+#pragma once
+#include <fc/reflect/reflect.hpp>
+#include <fc/io/datastream.hpp>
+#include <fc/io/enum_type.hpp>
+#include <fc/io/varint.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/array.hpp>
+#include <fc/uint128.hpp>
+#include <fc/time.hpp>
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha224.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/crypto/sha512.hpp>
+
+#include <string>
+#include <vector>
+#include <type_traits>
+
+namespace bts { namespace db {
+
+  /**
+   *  @file key_encoding.hpp
+   *
+   *  Keys stored in a level_map or level_pod_map are packed so that comparing
+   *  the packed bytes with memcmp gives the same order as operator< on the key.
+   *  This allows the databases to use LevelDB's default bytewise comparator
+   *  rather than unpacking both keys on every comparison.
+   *
+   *  - unsigned integers are packed big-endian
+   *  - signed integers are packed big-endian with the sign bit flipped
+   *  - hashes and fixed arrays are packed as their raw bytes
+   *  - strings escape 0x00 as 0x00 0xff and are terminated by 0x00 0x01
+   *  - reflected structs pack each member in the order they are reflected
+   *
+   *  A reflected struct sorts correctly only if its operator< compares the
+   *  reflected members lexicographically in reflection order.
+   */
+
+  typedef fc::datastream<const char*> key_stream;
+
+  namespace detail
+  {
+     inline void pack_big_endian( std::vector<char>& out, uint64_t v, size_t bytes )
+     {
+        for( size_t i = bytes; i > 0; --i )
+        {
+           out.push_back( char( (v >> (8*(i-1))) & 0xff ) );
+        }
+     }
+
+     inline uint64_t unpack_big_endian( key_stream& ds, size_t bytes )
+     {
+        unsigned char buf[8];
+        FC_ASSERT( bytes <= sizeof(buf) );
+        ds.read( (char*)buf, bytes );
+        uint64_t v = 0;
+        for( size_t i = 0; i < bytes; ++i )
+        {
+           v = (v << 8) | buf[i];
+        }
+        return v;
+     }
+
+     template<typename T, bool Integral = std::is_integral<T>::value, bool Enum = std::is_enum<T>::value>
+     struct key_packer;
+  }
+
+  template<typename T> void pack_key( std::vector<char>& out, const T& v );
+  template<typename T> void unpack_key( key_stream& ds, T& v );
+
+  inline void pack_key( std::vector<char>& out, const std::string& s )
+  {
+     for( auto itr = s.begin(); itr != s.end(); ++itr )
+     {
+        out.push_back( *itr );
+        if( *itr == 0 ) out.push_back( char(0xff) );
+     }
+     out.push_back( 0 );
+     out.push_back( 1 );
+  }
+  inline void unpack_key( key_stream& ds, std::string& s )
+  {
+     s.clear();
+     while( true )
+     {
+        char c;
+        ds.read( &c, 1 );
+        if( c != 0 )
+        {
+           s.push_back( c );
+           continue;
+        }
+        char esc;
+        ds.read( &esc, 1 );
+        if( esc == 1 ) return;
+        FC_ASSERT( esc == char(0xff), "invalid escape in string key" );
+        s.push_back( 0 );
+     }
+  }
+
+  inline void pack_key( std::vector<char>& out, const fc::uint128& v )
+  {
+     detail::pack_big_endian( out, v.high_bits(), 8 );
+     detail::pack_big_endian( out, v.low_bits(), 8 );
+  }
+  inline void unpack_key( key_stream& ds, fc::uint128& v )
+  {
+     uint64_t hi = detail::unpack_big_endian( ds, 8 );
+     uint64_t lo = detail::unpack_big_endian( ds, 8 );
+     v = fc::uint128( hi, lo );
+  }
+
+  inline void pack_key( std::vector<char>& out, const fc::unsigned_int& v )
+  {
+     detail::pack_big_endian( out, v.value, sizeof(v.value) );
+  }
+  inline void unpack_key( key_stream& ds, fc::unsigned_int& v )
+  {
+     v = fc::unsigned_int( uint32_t(detail::unpack_big_endian( ds, sizeof(v.value) )) );
+  }
+
+  inline void pack_key( std::vector<char>& out, const fc::time_point& v )
+  {
+     pack_key( out, int64_t(v.time_since_epoch().count()) );
+  }
+  inline void unpack_key( key_stream& ds, fc::time_point& v )
+  {
+     int64_t us;
+     unpack_key( ds, us );
+     v = fc::time_point( fc::microseconds(us) );
+  }
+
+  inline void pack_key( std::vector<char>& out, const fc::time_point_sec& v )
+  {
+     pack_key( out, uint32_t(v.sec_since_epoch()) );
+  }
+  inline void unpack_key( key_stream& ds, fc::time_point_sec& v )
+  {
+     uint32_t sec;
+     unpack_key( ds, sec );
+     v = fc::time_point_sec( sec );
+  }
+
+  /** hashes compare with memcmp so they are packed as is */
+  #define BTS_DB_RAW_BYTES_KEY( TYPE ) \
+  inline void pack_key( std::vector<char>& out, const TYPE& v ) \
+  { \
+     out.insert( out.end(), (const char*)&v, (const char*)&v + sizeof(v) ); \
+  } \
+  inline void unpack_key( key_stream& ds, TYPE& v ) \
+  { \
+     ds.read( (char*)&v, sizeof(v) ); \
+  }
+
+  BTS_DB_RAW_BYTES_KEY( fc::ripemd160 )
+  BTS_DB_RAW_BYTES_KEY( fc::sha224 )
+  BTS_DB_RAW_BYTES_KEY( fc::sha256 )
+  BTS_DB_RAW_BYTES_KEY( fc::sha512 )
+
+  #undef BTS_DB_RAW_BYTES_KEY
+
+  template<typename T, size_t N>
+  void pack_key( std::vector<char>& out, const fc::array<T,N>& v )
+  {
+     out.insert( out.end(), (const char*)v.data, (const char*)v.data + sizeof(v.data) );
+  }
+  template<typename T, size_t N>
+  void unpack_key( key_stream& ds, fc::array<T,N>& v )
+  {
+     ds.read( (char*)v.data, sizeof(v.data) );
+  }
+
+  template<typename IntType, typename EnumType>
+  void pack_key( std::vector<char>& out, const fc::enum_type<IntType,EnumType>& v )
+  {
+     pack_key( out, IntType( v.value ) );
+  }
+  template<typename IntType, typename EnumType>
+  void unpack_key( key_stream& ds, fc::enum_type<IntType,EnumType>& v )
+  {
+     IntType tmp;
+     unpack_key( ds, tmp );
+     v = fc::enum_type<IntType,EnumType>( tmp );
+  }
+
+  namespace detail
+  {
+     template<typename T>
+     struct key_packer<T,true,false>
+     {
+        static void pack( std::vector<char>& out, const T& v )
+        {
+           uint64_t u = uint64_t(v);
+           if( std::is_signed<T>::value ) u ^= uint64_t(1) << (8*sizeof(T)-1);
+           pack_big_endian( out, u, sizeof(T) );
+        }
+        static void unpack( key_stream& ds, T& v )
+        {
+           uint64_t u = unpack_big_endian( ds, sizeof(T) );
+           if( std::is_signed<T>::value ) u ^= uint64_t(1) << (8*sizeof(T)-1);
+           v = T(u);
+        }
+     };
+
+     template<typename T>
+     struct key_packer<T,false,true>
+     {
+        static void pack( std::vector<char>& out, const T& v )
+        {
+           pack_big_endian( out, uint64_t(v), sizeof(T) );
+        }
+        static void unpack( key_stream& ds, T& v )
+        {
+           v = T( unpack_big_endian( ds, sizeof(T) ) );
+        }
+     };
+
+     template<typename Class>
+     struct pack_key_visitor
+     {
+        pack_key_visitor( const Class& _c, std::vector<char>& _out ):c(_c),out(_out){}
+
+        template<typename T, typename C, T(C::*p)>
+        void operator()( const char* name )const
+        {
+           pack_key( out, c.*p );
+        }
+        const Class&       c;
+        std::vector<char>& out;
+     };
+
+     template<typename Class>
+     struct unpack_key_visitor
+     {
+        unpack_key_visitor( Class& _c, key_stream& _ds ):c(_c),ds(_ds){}
+
+        template<typename T, typename C, T(C::*p)>
+        void operator()( const char* name )const
+        {
+           unpack_key( ds, c.*p );
+        }
+        Class&      c;
+        key_stream& ds;
+     };
+
+     /** any other key must be reflected */
+     template<typename T>
+     struct key_packer<T,false,false>
+     {
+        static void pack( std::vector<char>& out, const T& v )
+        {
+           fc::reflector<T>::visit( pack_key_visitor<T>( v, out ) );
+        }
+        static void unpack( key_stream& ds, T& v )
+        {
+           fc::reflector<T>::visit( unpack_key_visitor<T>( v, ds ) );
+        }
+     };
+  } // namespace detail
+
+  template<typename T>
+  void pack_key( std::vector<char>& out, const T& v )
+  {
+     detail::key_packer<T>::pack( out, v );
+  }
+  template<typename T>
+  void unpack_key( key_stream& ds, T& v )
+  {
+     detail::key_packer<T>::unpack( ds, v );
+  }
+
+  template<typename T>
+  std::vector<char> pack_key( const T& v )
+  {
+     std::vector<char> out;
+     pack_key( out, v );
+     return out;
+  }
+
+  template<typename T>
+  T unpack_key( const char* data, size_t size )
+  {
+     key_stream ds( data, size );
+     T tmp;
+     unpack_key( ds, tmp );
+     return tmp;
+  }
+
+} } // bts::db
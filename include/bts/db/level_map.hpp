@@ -1,15 +1,24 @@
 #pragma once
 #include <leveldb/db.h>
 #include <leveldb/comparator.h>
+#include <leveldb/write_batch.h>
 
 #include <fc/filesystem.hpp>
 
 #include <fc/reflect/reflect.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/exception/exception.hpp>
+#include <fc/optional.hpp>
 
 #include <fc/log/logger.hpp>
 
+#include <bts/db/key_encoding.hpp>
+#include <bts/db/value_encoding.hpp>
+#include <bts/db/upgrade_leveldb.hpp>
+#include <bts/db/db_environment.hpp>
+#include <bts/db/level_snapshot.hpp>
+#include <bts/db/value_cache.hpp>
+
 namespace bts { namespace db {
 
   namespace ldb = leveldb;
@@ -17,16 +26,20 @@ namespace bts { namespace db {
   /**
    *  @brief implements a high-level API on top of Level DB that stores items using fc::raw / reflection
    *
+   *  Keys are packed with pack_key() so that the database can use the default
+   *  bytewise comparator, see key_encoding.hpp.
    */
   template<typename Key, typename Value>
   class level_map
   {
      public:
-        void open( const fc::path& dir, bool create = true )
+        /** @param profile - selects LevelDB options for how the database is used, see db_environment */
+        void open( const fc::path& dir, bool create = true, db_profile profile = default_profile )
         {
-           ldb::Options opts;
+           detail::recover_interrupted_upgrade( dir );
+
+           ldb::Options opts = db_environment::instance().options( profile );
            opts.create_if_missing = create;
-           opts.comparator = & _comparer;
 
            /// \waring Given path must exist to succeed toNativeAnsiPath
            fc::create_directories(dir);
@@ -35,6 +48,17 @@ namespace bts { namespace db {
 
            ldb::DB* ndb = nullptr;
            auto ntrxstat = ldb::DB::Open( opts, ldbPath.c_str(), &ndb );
+           if( detail::is_legacy_comparator( ntrxstat ) )
+           {
+               detail::upgrade_legacy_db( dir, &_legacy_comparer, []( const ldb::Slice& legacy_key ) -> std::vector<char>
+               {
+                   Key k;
+                   fc::datastream<const char*> ds( legacy_key.data(), legacy_key.size() );
+                   fc::raw::unpack( ds, k );
+                   return pack_key( k );
+               });
+               ntrxstat = ldb::DB::Open( opts, ldbPath.c_str(), &ndb );
+           }
            if( !ntrxstat.ok() )
            {
                FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}", 
@@ -48,63 +72,143 @@ namespace bts { namespace db {
         void close()
         {
           _db.reset();
+          // the same map may be opened on another database
+          _cache.clear();
         }
 
+        /** @throw key_not_found_exception if k is not in the database */
         Value fetch( const Key& k )
         {
           try {
-             std::vector<char> kslice = fc::raw::pack( k );
-             ldb::Slice ks( kslice.data(), kslice.size() );
-             std::string value;
-             auto status = _db->Get( ldb::ReadOptions(), ks, &value );
-             if( status.IsNotFound() )
+             Value tmp;
+             if( !read( pack_key( k ), tmp ) )
              {
                FC_THROW_EXCEPTION( key_not_found_exception, "unable to find key ${key}", ("key",k) );
              }
-             if( !status.ok() )
-             {
-                 FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
-             }
-             fc::datastream<const char*> ds(value.c_str(), value.size());
+             return tmp;
+          } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) );
+        }
+
+        /**
+         *  @return the value stored at k, null if there is none.  Unlike fetch()
+         *          a miss does not construct an exception.
+         */
+        fc::optional<Value> try_fetch( const Key& k )
+        {
+          try {
              Value tmp;
-             fc::raw::unpack(ds, tmp);
+             if( !read( pack_key( k ), tmp ) ) return fc::optional<Value>();
              return tmp;
           } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) );
         }
 
+        /** @return true if a value is stored at k */
+        bool contains( const Key& k )
+        {
+          try {
+             std::vector<char> packed = pack_key( k );
+             if( _cache.enabled() && _cache.contains( std::string( packed.begin(), packed.end() ) ) ) return true;
+             std::string value;
+             return get( packed, value );
+          } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) );
+        }
+
+        /**
+         *  Calls visitor( fc::datastream<const char*>& ) with a stream over the
+         *  value packed at k, read in place from LevelDB's block rather than
+         *  copied out and fully decoded.  Bypasses the value cache and the bloom
+         *  filter, so prefer try_fetch for lookups that usually miss.
+         *
+         *  @return false if k is not in the database
+         */
+        template<typename Visitor>
+        bool visit( const Key& k, Visitor&& visitor )
+        {
+          try {
+             std::vector<char> packed = pack_key( k );
+             ldb::Slice key_slice( packed.data(), packed.size() );
+             std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
+             it->Seek( key_slice );
+             if( !it->status().ok() )
+             {
+                 FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", it->status().ToString() ) );
+             }
+             if( !it->Valid() || it->key() != key_slice ) return false;
+             fc::datastream<const char*> ds( it->value().data(), it->value().size() );
+             visitor( ds );
+             return true;
+          } FC_RETHROW_EXCEPTIONS( warn, "error visiting key ${key}", ("key",k) );
+        }
+
+        /**
+         *  Keeps up to entries decoded values in memory, least recently used
+         *  first out.  Values are dropped when they are stored or removed,
+         *  directly or through a batch.  0, the default, disables the cache.
+         */
+        void set_cache_size( uint32_t entries )
+        {
+           _cache.set_capacity( entries );
+        }
+
+        cache_stats get_cache_stats()const
+        {
+           return _cache.get_stats();
+        }
+
         class iterator
         {
            public:
-             iterator(){}
+             iterator():_bounded(false){}
              bool valid()const 
              {
-                return _it && _it->Valid(); 
+                return _it && _it->Valid() && ( !_bounded || _it->key().compare( ldb::Slice( _end ) ) < 0 );
              }
 
              Key key()const
              {
-                 Key tmp_key;
-                 fc::datastream<const char*> ds2( _it->key().data(), _it->key().size() );
-                 fc::raw::unpack( ds2, tmp_key );
-                 return tmp_key;
+                 return unpack_key<Key>( _it->key().data(), _it->key().size() );
              }
 
              Value value()const
              {
                Value tmp_val;
-               fc::datastream<const char*> ds( _it->value().data(), _it->value().size() );
-               fc::raw::unpack( ds, tmp_val );
+               value( tmp_val );
                return tmp_val;
              }
 
+             /** decodes the value into v, replacing everything v held before */
+             void value( Value& v )const
+             {
+               unpack_value( _it->value().data(), _it->value().size(), v );
+             }
+
+             /**
+              *  Calls visitor( fc::datastream<const char*>& ) with a stream over
+              *  the packed value so that it can unpack only the leading fields
+              *  it needs.  The stream is only valid during the call.
+              */
+             template<typename Visitor>
+             void visit_value( Visitor&& visitor )const
+             {
+               fc::datastream<const char*> ds( _it->value().data(), _it->value().size() );
+               visitor( ds );
+             }
+
+             /** the packed key and value, valid until the iterator is moved */
+             ldb::Slice raw_key()const   { return _it->key();   }
+             ldb::Slice raw_value()const { return _it->value(); }
+
              iterator& operator++() { _it->Next(); return *this; }
              iterator& operator--() { _it->Prev(); return *this; }
            
            protected:
              friend class level_map;
              iterator( ldb::Iterator* it )
-             :_it(it){}
+             :_bounded(false),_it(it){}
 
+             bool                           _bounded;
+             std::string                    _end;      // packed upper bound, exclusive
+             snapshot_ptr                   _snapshot; // released after _it
              std::shared_ptr<ldb::Iterator> _it;
         };
         iterator begin() 
@@ -130,11 +234,11 @@ namespace bts { namespace db {
 
         iterator find( const Key& key )
         { try {
-           std::vector<char> kslice = fc::raw::pack( key );
+           std::vector<char> kslice = pack_key( key );
            ldb::Slice key_slice( kslice.data(), kslice.size() );
            iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
            itr._it->Seek( key_slice );
-           if( itr.valid() && itr.key() == key ) 
+           if( itr.valid() && itr.raw_key() == key_slice )
            {
               return itr;
            }
@@ -143,7 +247,8 @@ namespace bts { namespace db {
 
         iterator lower_bound( const Key& key )
         { try {
-           ldb::Slice key_slice( (char*)&key, sizeof(key) );
+           std::vector<char> kslice = pack_key( key );
+           ldb::Slice key_slice( kslice.data(), kslice.size() );
            iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
            itr._it->Seek( key_slice );
            if( itr.valid()  ) 
@@ -154,6 +259,65 @@ namespace bts { namespace db {
         } FC_RETHROW_EXCEPTIONS( warn, "error finding ${key}", ("key",key) ) }
 
 
+        /** @return a consistent view for scan_options::snapshot, release it before close() */
+        snapshot_ptr get_snapshot()
+        {
+           return std::make_shared<level_snapshot>( _db.get() );
+        }
+
+        /** @return an iterator at the first key, read as described by opts */
+        iterator begin( const scan_options& opts )
+        { try {
+           iterator itr( _db->NewIterator( opts.read_options() ) );
+           itr._snapshot = opts.snapshot;
+           itr._it->SeekToFirst();
+           if( !itr._it->status().ok() )
+           {
+               FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", itr._it->status().ToString() ) );
+           }
+           if( itr.valid() )
+           {
+              return itr;
+           }
+           return iterator();
+        } FC_RETHROW_EXCEPTIONS( warn, "error seeking to first" ) }
+
+        /** @return an iterator at the first key not less than key, read as described by opts */
+        iterator lower_bound( const Key& key, const scan_options& opts )
+        { try {
+           std::vector<char> kslice = pack_key( key );
+           ldb::Slice key_slice( kslice.data(), kslice.size() );
+           iterator itr( _db->NewIterator( opts.read_options() ) );
+           itr._snapshot = opts.snapshot;
+           itr._it->Seek( key_slice );
+           if( !itr._it->status().ok() )
+           {
+               FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", itr._it->status().ToString() ) );
+           }
+           if( itr.valid() )
+           {
+              return itr;
+           }
+           return iterator();
+        } FC_RETHROW_EXCEPTIONS( warn, "error finding ${key}", ("key",key) ) }
+
+        /**
+         *  Iterates the keys in [lo, hi).  The iterator becomes invalid at hi so
+         *  the caller never decodes anything past the end of the range.
+         */
+        iterator range( const Key& lo, const Key& hi, const scan_options& opts = scan_options() )
+        { try {
+           iterator itr = lower_bound( lo, opts );
+           std::vector<char> end = pack_key( hi );
+           itr._end.assign( end.begin(), end.end() );
+           itr._bounded = true;
+           if( itr.valid() )
+           {
+              return itr;
+           }
+           return iterator();
+        } FC_RETHROW_EXCEPTIONS( warn, "error finding range ${lo} to ${hi}", ("lo",lo)("hi",hi) ) }
+
         bool last( Key& k )
         {
           try {
@@ -164,8 +328,7 @@ namespace bts { namespace db {
              {
                return false;
              }
-             fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-             fc::raw::unpack( ds2, k );
+             k = unpack_key<Key>( it->key().data(), it->key().size() );
              return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
@@ -180,11 +343,9 @@ namespace bts { namespace db {
            {
              return false;
            }
-           fc::datastream<const char*> ds( it->value().data(), it->value().size() );
-           fc::raw::unpack( ds, v );
+           unpack_value( it->value().data(), it->value().size(), v );
 
-           fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-           fc::raw::unpack( ds2, k );
+           k = unpack_key<Key>( it->key().data(), it->key().size() );
            return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
@@ -193,7 +354,7 @@ namespace bts { namespace db {
         {
           try
           {
-             std::vector<char> kslice = fc::raw::pack( k );
+             std::vector<char> kslice = pack_key( k );
              ldb::Slice ks( kslice.data(), kslice.size() );
 
              auto vec = fc::raw::pack(v);
@@ -204,6 +365,7 @@ namespace bts { namespace db {
              {
                  FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
              }
+             if( _cache.enabled() ) _cache.erase( std::string( kslice.begin(), kslice.end() ) );
           } FC_RETHROW_EXCEPTIONS( warn, "error storing ${key} = ${value}", ("key",k)("value",v) );
         }
 
@@ -211,7 +373,7 @@ namespace bts { namespace db {
         {
           try
           {
-             std::vector<char> kslice = fc::raw::pack( k );
+             std::vector<char> kslice = pack_key( k );
              ldb::Slice ks( kslice.data(), kslice.size() );
              auto status = _db->Delete( ldb::WriteOptions(), ks );
              if( status.IsNotFound() )
@@ -222,12 +384,124 @@ namespace bts { namespace db {
              {
                  FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
              }
+             if( _cache.enabled() ) _cache.erase( std::string( kslice.begin(), kslice.end() ) );
           } FC_RETHROW_EXCEPTIONS( warn, "error removing ${key}", ("key",k) );
         }
+
+        /**
+         *  Queues k = v in batch rather than writing it immediately, the change
+         *  is applied along with everything else in batch by write( batch ).
+         */
+        void store( const Key& k, const Value& v, ldb::WriteBatch& batch )
+        {
+          try
+          {
+             std::vector<char> kslice = pack_key( k );
+             ldb::Slice ks( kslice.data(), kslice.size() );
+             auto vec = fc::raw::pack(v);
+             ldb::Slice vs( vec.data(), vec.size() );
+
+             batch.Put( ks, vs );
+          } FC_RETHROW_EXCEPTIONS( warn, "error queuing ${key} = ${value}", ("key",k)("value",v) );
+        }
+
+        /**
+         *  Queues the removal of k in batch, the change is applied along with
+         *  everything else in batch by write( batch ).
+         */
+        void remove( const Key& k, ldb::WriteBatch& batch )
+        {
+          try
+          {
+             std::vector<char> kslice = pack_key( k );
+             ldb::Slice ks( kslice.data(), kslice.size() );
+             batch.Delete( ks );
+          } FC_RETHROW_EXCEPTIONS( warn, "error queuing removal of ${key}", ("key",k) );
+        }
+
+        /**
+         *  Atomically applies all changes queued in batch.
+         *
+         *  @param sync - wait for the changes to reach stable storage before returning
+         */
+        void write( ldb::WriteBatch& batch, bool sync = false )
+        {
+          try
+          {
+             ldb::WriteOptions opts;
+             opts.sync = sync;
+             auto status = _db->Write( opts, &batch );
+             if( !status.ok() )
+             {
+                 FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+             }
+             if( _cache.enabled() ) _cache.erase( batch );
+          } FC_RETHROW_EXCEPTIONS( warn, "error writing batch" );
+        }
+
+        /**
+         *  Compacts the keys from begin up to end so that the space of removed 
+         *  items in that range is reclaimed.
+         */
+        void compact( const Key& begin, const Key& end )
+        {
+          try
+          {
+             std::vector<char> begin_key = pack_key( begin );
+             std::vector<char> end_key   = pack_key( end );
+             ldb::Slice begin_slice( begin_key.data(), begin_key.size() );
+             ldb::Slice end_slice( end_key.data(), end_key.size() );
+             _db->CompactRange( &begin_slice, &end_slice );
+          } FC_RETHROW_EXCEPTIONS( warn, "error compacting ${begin} to ${end}", ("begin",begin)("end",end) );
+        }
         
 
      private:
-        class key_compare : public leveldb::Comparator
+        /** 
+         *  Reads the packed value stored at the packed key.
+         *
+         *  @return false if the key is not in the database
+         *  @throw  on any other database error
+         */
+        bool get( const std::vector<char>& packed, std::string& value )
+        {
+           ldb::Slice ks( packed.data(), packed.size() );
+           auto status = _db->Get( ldb::ReadOptions(), ks, &value );
+           if( status.IsNotFound() ) return false;
+           if( !status.ok() )
+           {
+               FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+           }
+           return true;
+        }
+
+        /** decodes the value stored at the packed key into v, going through the cache */
+        bool read( const std::vector<char>& packed, Value& v )
+        {
+           if( !_cache.enabled() )
+           {
+              std::string value;
+              if( !get( packed, value ) ) return false;
+              unpack_value( value.c_str(), value.size(), v );
+              return true;
+           }
+
+           std::string cache_key( packed.begin(), packed.end() );
+           if( _cache.get( cache_key, v ) ) return true;
+
+           uint64_t gen = _cache.generation();
+           std::string value;
+           if( !get( packed, value ) ) return false;
+           unpack_value( value.c_str(), value.size(), v );
+           _cache.put( cache_key, v, gen );
+           return true;
+        }
+
+        /**
+         *  The comparator databases were created with before keys were packed 
+         *  with pack_key(), only used to read them while upgrading.
+         */
+        class legacy_key_compare : public leveldb::Comparator
         {
           public:
             int Compare( const leveldb::Slice& a, const leveldb::Slice& b )const
@@ -248,8 +522,9 @@ namespace bts { namespace db {
             void FindShortSuccessor( std::string* )const{};
         };
 
-        key_compare                  _comparer;
+        legacy_key_compare           _legacy_comparer;
         std::unique_ptr<leveldb::DB> _db;
+        detail::value_cache<Value>   _cache;
         
   };
 
@@ -0,0 +1,60 @@
+#pragma once
+#include <leveldb/db.h>
+#include <leveldb/options.h>
+
+#include <memory>
+
+namespace bts { namespace db {
+
+  namespace ldb = leveldb;
+
+  /**
+   *  A read only view of one database as it was when the snapshot was taken.
+   *  Writes made afterward are not visible through it.  The snapshot is
+   *  released when the last reference goes away, which must happen before
+   *  the database it came from is closed.
+   */
+  class level_snapshot
+  {
+     public:
+        level_snapshot( ldb::DB* db )
+        :_db(db),_snapshot( db->GetSnapshot() ){}
+
+        ~level_snapshot()
+        {
+           _db->ReleaseSnapshot( _snapshot );
+        }
+
+        const ldb::Snapshot* get()const { return _snapshot; }
+
+     private:
+        level_snapshot( const level_snapshot& );
+        level_snapshot& operator=( const level_snapshot& );
+
+        ldb::DB*             _db;
+        const ldb::Snapshot* _snapshot;
+  };
+  typedef std::shared_ptr<level_snapshot> snapshot_ptr;
+
+  /**
+   *  How a range scan reads the database.  By default a scan reads the latest
+   *  state and does not load the blocks it reads into the shared block cache,
+   *  so that one long scan does not evict the blocks used by point lookups.
+   */
+  struct scan_options
+  {
+     scan_options():fill_cache(false){}
+
+     snapshot_ptr snapshot;   ///< read as of this snapshot, the latest state if null
+     bool         fill_cache; ///< keep the blocks read by the scan in the block cache
+
+     ldb::ReadOptions read_options()const
+     {
+        ldb::ReadOptions opts;
+        opts.fill_cache = fill_cache;
+        if( snapshot ) opts.snapshot = snapshot->get();
+        return opts;
+     }
+  };
+
+} } // bts::db
@@ -0,0 +1,119 @@
+#pragma once
+#include <leveldb/db.h>
+#include <leveldb/comparator.h>
+#include <leveldb/write_batch.h>
+
+#include <fc/filesystem.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <memory>
+
+namespace bts { namespace db {
+
+  namespace ldb = leveldb;
+
+  namespace detail
+  {
+     inline fc::path upgrade_path( const fc::path& dir ) { return fc::path( dir.generic_string() + ".upgrade" ); }
+     inline fc::path legacy_path( const fc::path& dir )  { return fc::path( dir.generic_string() + ".legacy" );  }
+
+     /**
+      *  Databases created before keys were packed with key_encoding.hpp used a
+      *  custom comparator, LevelDB refuses to open them with the bytewise one.
+      */
+     inline bool is_legacy_comparator( const ldb::Status& s )
+     {
+        return !s.ok() && s.ToString().find( "does not match existing comparator" ) != std::string::npos;
+     }
+
+     /**
+      *  If the process stopped after the legacy database was moved aside but
+      *  before the upgraded copy took its place, put the legacy one back so that
+      *  the upgrade is simply run again.
+      */
+     inline void recover_interrupted_upgrade( const fc::path& dir )
+     {
+        if( !fc::exists( dir ) && fc::exists( legacy_path( dir ) ) )
+        {
+           wlog( "recovering ${dir} from an interrupted upgrade", ("dir",dir) );
+           fc::rename( legacy_path( dir ), dir );
+        }
+     }
+
+     /**
+      *  Copies every record in the legacy database at dir into a new database
+      *  whose keys are converted by convert_key, then replaces dir with the copy.
+      *  Values are copied unchanged.
+      *
+      *  @param legacy_compare - the comparator the legacy database was created with
+      *  @param convert_key    - std::vector<char>( const ldb::Slice& legacy_key )
+      */
+     template<typename ConvertKey>
+     void upgrade_legacy_db( const fc::path& dir, const ldb::Comparator* legacy_compare, ConvertKey convert_key )
+     { try {
+        ilog( "upgrading key encoding of ${dir}", ("dir",dir) );
+
+        ldb::Options legacy_opts;
+        legacy_opts.comparator = legacy_compare;
+        ldb::DB* legacy_db = nullptr;
+        auto status = ldb::DB::Open( legacy_opts, dir.to_native_ansi_path().c_str(), &legacy_db );
+        if( !status.ok() )
+        {
+           FC_THROW_EXCEPTION( exception, "unable to open legacy database: ${msg}", ("msg", status.ToString() ) );
+        }
+        std::unique_ptr<ldb::DB> old_db( legacy_db );
+
+        auto new_dir = upgrade_path( dir );
+        if( fc::exists( new_dir ) ) fc::remove_all( new_dir );
+
+        ldb::Options new_opts;
+        new_opts.create_if_missing = true;
+        ldb::DB* upgraded_db = nullptr;
+        status = ldb::DB::Open( new_opts, new_dir.to_native_ansi_path().c_str(), &upgraded_db );
+        if( !status.ok() )
+        {
+           FC_THROW_EXCEPTION( exception, "unable to create upgraded database: ${msg}", ("msg", status.ToString() ) );
+        }
+        std::unique_ptr<ldb::DB> new_db( upgraded_db );
+
+        ldb::ReadOptions read_opts;
+        read_opts.fill_cache = false;
+        std::unique_ptr<ldb::Iterator> itr( old_db->NewIterator( read_opts ) );
+
+        ldb::WriteBatch batch;
+        uint32_t        batched = 0;
+        uint64_t        total   = 0;
+        for( itr->SeekToFirst(); itr->Valid(); itr->Next() )
+        {
+           std::vector<char> key = convert_key( itr->key() );
+           batch.Put( ldb::Slice( key.data(), key.size() ), itr->value() );
+           ++total;
+           if( ++batched == 1024 )
+           {
+              status = new_db->Write( ldb::WriteOptions(), &batch );
+              FC_ASSERT( status.ok(), "${msg}", ("msg", status.ToString() ) );
+              batch.Clear();
+              batched = 0;
+           }
+        }
+        FC_ASSERT( itr->status().ok(), "${msg}", ("msg", itr->status().ToString() ) );
+
+        ldb::WriteOptions sync_opts;
+        sync_opts.sync = true;
+        status = new_db->Write( sync_opts, &batch );
+        FC_ASSERT( status.ok(), "${msg}", ("msg", status.ToString() ) );
+
+        itr.reset();
+        old_db.reset();
+        new_db.reset();
+
+        fc::rename( dir, legacy_path( dir ) );
+        fc::rename( new_dir, dir );
+        fc::remove_all( legacy_path( dir ) );
+
+        ilog( "upgraded ${n} records in ${dir}", ("n",total)("dir",dir) );
+     } FC_RETHROW_EXCEPTIONS( warn, "error upgrading database ${dir}", ("dir",dir) ) }
+  } // namespace detail
+
+} } // bts::db
@@ -0,0 +1,169 @@
+#pragma once
+#include <leveldb/write_batch.h>
+#include <fc/reflect/reflect.hpp>
+#include <fc/thread/mutex.hpp>
+#include <fc/thread/scoped_lock.hpp>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace bts { namespace db {
+
+  struct cache_stats
+  {
+     cache_stats():hits(0),misses(0),evictions(0),size(0),capacity(0){}
+     uint64_t hits;
+     uint64_t misses;
+     uint64_t evictions;
+     uint32_t size;
+     uint32_t capacity;
+  };
+
+  namespace detail
+  {
+     /**
+      *  Least recently used cache of decoded values keyed by packed key, used
+      *  by level_map and level_pod_map to skip LevelDB and fc::raw::unpack
+      *  on repeated reads.  It is disabled until it is given a capacity.
+      *
+      *  Every invalidation bumps a generation counter.  A reader records the
+      *  generation before it reads the database and the value is only cached
+      *  if nothing was invalidated in between, so a read that races a write
+      *  cannot leave the old value behind.
+      */
+     template<typename Value>
+     class value_cache
+     {
+        public:
+           value_cache():_capacity(0),_generation(0){}
+
+           /** read without the lock, the capacity is set when the map is opened */
+           bool     enabled()const { return _capacity > 0; }
+
+           uint64_t generation()const
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              return _generation;
+           }
+
+           /** @return true and sets v if key is cached, counting a hit or a miss */
+           bool get( const std::string& key, Value& v )
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              auto itr = _index.find( key );
+              if( itr == _index.end() )
+              {
+                 ++_stats.misses;
+                 return false;
+              }
+              ++_stats.hits;
+              _lru.splice( _lru.begin(), _lru, itr->second );
+              v = itr->second->second;
+              return true;
+           }
+
+           /** @return true if key is cached without counting or reordering it */
+           bool contains( const std::string& key )const
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              return _index.find( key ) != _index.end();
+           }
+
+           /** caches v if there were no invalidations since generation read_gen */
+           void put( const std::string& key, const Value& v, uint64_t read_gen )
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              if( _capacity == 0 || read_gen != _generation ) return;
+              if( _index.find( key ) != _index.end() ) return;
+              _lru.push_front( std::make_pair( key, v ) );
+              _index[key] = _lru.begin();
+              evict_to( _capacity );
+           }
+
+           void erase( const std::string& key )
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              ++_generation;
+              erase_locked( key );
+           }
+
+           /** drops every key written by batch */
+           void erase( const leveldb::WriteBatch& batch )
+           {
+              batch_keys keys;
+              batch.Iterate( &keys );
+
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              ++_generation;
+              for( auto itr = keys.keys.begin(); itr != keys.keys.end(); ++itr )
+              {
+                 erase_locked( *itr );
+              }
+           }
+
+           /** drops every entry, used when the database is closed */
+           void clear()
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              ++_generation;
+              _lru.clear();
+              _index.clear();
+           }
+
+           void set_capacity( uint32_t capacity )
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              _capacity = capacity;
+              evict_to( capacity );
+           }
+
+           cache_stats get_stats()const
+           {
+              fc::scoped_lock<fc::mutex> lock( _lock );
+              cache_stats s = _stats;
+              s.size        = _lru.size();
+              s.capacity    = _capacity;
+              return s;
+           }
+
+        private:
+           typedef std::list< std::pair<std::string,Value> > lru_list;
+
+           struct batch_keys : public leveldb::WriteBatch::Handler
+           {
+              std::vector<std::string> keys;
+              virtual void Put( const leveldb::Slice& key, const leveldb::Slice& ) { keys.push_back( key.ToString() ); }
+              virtual void Delete( const leveldb::Slice& key )                     { keys.push_back( key.ToString() ); }
+           };
+
+           void erase_locked( const std::string& key )
+           {
+              auto itr = _index.find( key );
+              if( itr == _index.end() ) return;
+              _lru.erase( itr->second );
+              _index.erase( itr );
+           }
+
+           void evict_to( uint32_t size )
+           {
+              while( _lru.size() > size )
+              {
+                 _index.erase( _lru.back().first );
+                 _lru.pop_back();
+                 ++_stats.evictions;
+              }
+           }
+
+           uint32_t                                             _capacity;
+           uint64_t                                             _generation;
+           lru_list                                             _lru; // most recently used first
+           std::unordered_map<std::string,typename lru_list::iterator> _index;
+           cache_stats                                          _stats;
+           mutable fc::mutex                                    _lock;
+     };
+  } // namespace detail
+
+} } // bts::db
+
+FC_REFLECT( bts::db::cache_stats, (hits)(misses)(evictions)(size)(capacity) )
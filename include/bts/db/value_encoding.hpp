@@ -0,0 +1,25 @@
+#pragma once
+#include <fc/io/raw.hpp>
+
+#include <utility>
+
+namespace bts { namespace db {
+
+  /**
+   *  Decodes the packed value in data into v.
+   *
+   *  fc::raw::unpack only assigns the reflected members of an existing object, 
+   *  so state that is not reflected, such as the memoized id of a transaction 
+   *  or block header, would survive from whatever v held before.  The value is
+   *  decoded into a new object and moved into v instead.
+   */
+  template<typename Value>
+  void unpack_value( const char* data, size_t size, Value& v )
+  {
+     fc::datastream<const char*> ds( data, size );
+     Value tmp;
+     fc::raw::unpack( ds, tmp );
+     v = std::move( tmp );
+  }
+
+} } // bts::db
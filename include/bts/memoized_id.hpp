@@ -0,0 +1,45 @@
+#pragma once
+
+namespace bts
+{
+  /**
+   *  Remembers the id of the object that owns it so that the object is only
+   *  packed and hashed the first time its id is requested.
+   *
+   *  The owner cannot detect changes made to its public members, so any code
+   *  that modifies an object after its id may have been computed must call
+   *  reset().  Copies carry the id along with the rest of the object.
+   *
+   *  fc::raw::unpack assigns the reflected members one by one and leaves the
+   *  memoized id alone, so an object must be unpacked into a new instance, or
+   *  have reset() called afterward, rather than decoded over a used one.
+   *  level_map and level_pod_map do this with bts::db::unpack_value().
+   *
+   *  This is not synchronized, one object must not have its id computed by
+   *  two threads at once.
+   */
+  template<typename IdType>
+  class memoized_id
+  {
+     public:
+        memoized_id():_valid(false){}
+
+        template<typename Calculate>
+        const IdType& get( Calculate&& calc )const
+        {
+           if( !_valid )
+           {
+              _id    = calc();
+              _valid = true;
+           }
+           return _id;
+        }
+
+        void reset()const { _valid = false; }
+
+     private:
+        mutable IdType _id;
+        mutable bool   _valid;
+  };
+
+} // bts
@@ -4,9 +4,16 @@
 
 namespace bts {
 
+  /** @return the parent of left and right, a missing right node is uint160() */
+  uint160 merkle_hash( const uint160& left, const uint160& right );
+
   /**
    *  Provides a merkle branch that proves a hash was
    *  included in the root.
+   *
+   *  mid_states[0] is the leaf being proven followed by its sibling on
+   *  each layer from the bottom up.  Bit i of branch is set when the node
+   *  on layer i is a right child, which for a leaf is its index.
    */
   struct merkle_branch
   {
@@ -22,14 +29,24 @@ namespace bts {
   /**
    *  Maintains a merkle tree as updates are made via
    *  get/set.
+   *
+   *  Odd layers are paired with uint160() and a tree of one leaf has the
+   *  leaf as its root, the same root as trx_block::calculate_merkle_root().
    */
   struct merkle_tree
   {
+       merkle_tree(){}
+
+       /** builds the tree over leaves in one pass */
+       explicit merkle_tree( std::vector<uint160> leaves );
+
        void     resize( uint64_t s );
-       uint64_t size();
+       uint64_t size()const;
 
        /** 
-        *  Updates all hashes in the merkle branch to index.
+        *  Updates all hashes in the merkle branch to index, setting index
+        *  size() appends a leaf.
+        *
         *  @throw out_of_range_exception if index > size
         */
        void       set( uint64_t index, const uint160& val );
@@ -41,6 +58,7 @@ namespace bts {
 
        /**
         *  @return the full merkle branch for the tree.
+        *  @throw out_of_range_exception if index >= size
         */
        merkle_branch get_branch( uint32_t index )const;
     
@@ -53,7 +71,8 @@ namespace bts {
 
        /**
         *  mtree[0] is the leef layer of the tree
-        *  mtree[mtree.size()-1].size() should always be 2
+        *  mtree[mtree.size()-1].size() should always be 2, unless
+        *  the tree has fewer than 2 leaves
         *
         *  @note only modify this via get/set to keep the
         *        struture accurate.  This is public for
@@ -118,7 +118,16 @@ namespace bts { namespace bitchat {
           void handle_cache_inv( const connection_ptr& c, chan_data& cdat, cache_inv_message msg )
           { try {
                ilog( "${msg}", ("msg",msg) );
-               c->send( network::message( get_cache_priv_message( msg.items ) ) );
+               // only request the items that are not already in our cache
+               std::vector<fc::uint128> unknown;
+               for( auto itr = msg.items.begin(); itr != msg.items.end(); ++itr )
+               {
+                  if( !_message_cache.contains( *itr ) ) unknown.push_back( *itr );
+               }
+               if( unknown.size() )
+               {
+                  c->send( network::message( get_cache_priv_message( unknown ) ) );
+               }
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) }
 
           void handle_get_cache_priv_msg(const connection_ptr& c, chan_data& cdat, get_cache_priv_message msg )
@@ -126,8 +135,9 @@ namespace bts { namespace bitchat {
               ilog( "${msg}", ("msg",msg) );
               for( auto itr = msg.items.begin(); itr != msg.items.end(); ++itr )
               {
-                 auto msg = _message_cache.fetch( *itr );
-                 c->send( network::message( msg, chan_id ) );
+                 // items purged since they were announced are skipped
+                 auto cached = _message_cache.try_fetch( *itr );
+                 if( cached ) c->send( network::message( *cached, chan_id ) );
               }
           } FC_RETHROW_EXCEPTIONS( warn, "", ("msg",msg) ) }
 
@@ -43,22 +43,31 @@ namespace bts { namespace bitchat {
      {
         public:
           db::level_pod_map<fc::uint128, encrypted_message> _cache_by_id;
-          db::level_pod_map<age_index,uint32_t>             _age_index; // TODO: convert to set, value not used
+          db::level_pod_map<age_index,uint32_t>             _age_index; // value is the size of the message data
           fc::mmap_struct<stats_data>                       _stats;
 
           void purge_old()
           { try {
              fc::time_point_sec expired = fc::time_point::now() - fc::seconds( BITCHAT_CACHE_WINDOW_SEC );
-             auto itr = _age_index.begin();
+             auto itr = _age_index.range( age_index(), age_index(expired,fc::uint128()) );
              while( itr.valid() )
              {
-                auto key = itr.key();
-                if( key.timestamp < expired )
+                auto   key       = itr.key();
+                size_t data_size = itr.value();
+                _age_index.remove(key);
+
+                // messages cached before the age index kept their size are read to find it
+                bool cached = data_size ? _cache_by_id.contains( key.message_id )
+                                        : _cache_by_id.visit( key.message_id, [&]( fc::datastream<const char*>& ds )
+                                          {
+                                             encrypted_message msg;
+                                             fc::raw::unpack( ds, msg );
+                                             data_size = msg.data.size();
+                                          } );
+                if( cached )
                 {
-                  _age_index.remove(key);
-                  auto msg = _cache_by_id.fetch(key.message_id);
-                  _stats->cache_size -= msg.data.size();
-                  _cache_by_id.remove(key.message_id);
+                   _stats->cache_size -= data_size;
+                   _cache_by_id.remove(key.message_id);
                 }
                 ++itr;
              }
@@ -92,8 +101,8 @@ namespace bts { namespace bitchat {
   void    message_cache::open( const fc::path& db_dir )
   { try {
        fc::create_directories( db_dir / "message_cache" );
-       my->_cache_by_id.open( db_dir / "message_cache" / "by_id"  );
-       my->_age_index.open( db_dir / "message_cache" / "age_index"  );
+       my->_cache_by_id.open( db_dir / "message_cache" / "by_id", true, db::point_lookup_profile );
+       my->_age_index.open( db_dir / "message_cache" / "age_index", true, db::scan_profile );
        my->_stats.open( db_dir / "message_cache" / "stats", true ); 
 
 
@@ -116,7 +125,7 @@ namespace bts { namespace bitchat {
      }
 
      my->_cache_by_id.store( id, msg );
-     my->_age_index.store( age_index(msg.timestamp, id), 0  );
+     my->_age_index.store( age_index(msg.timestamp, id), msg.data.size() );
      my->_stats->cache_size += msg.data.size();
      if( my->_stats->last_timestamp < fc::time_point(msg.timestamp) )
      {
@@ -126,17 +135,17 @@ namespace bts { namespace bitchat {
 
   std::vector<fc::uint128> message_cache::get_inventory( const fc::time_point& start_time, const fc::time_point& end_time )
   {
-      fc::time_point_sec endtime(end_time);
-      
+      // end_time is inclusive, the range ends before the next second
+      fc::time_point_sec after_end( fc::time_point_sec(end_time).sec_since_epoch() + 1 );
+
+      // read as of one snapshot so messages cached or purged during the scan are not half seen
+      bts::db::scan_options opts;
+      opts.snapshot = my->_age_index.get_snapshot();
+
       std::vector<fc::uint128> invent;
-      auto itr = my->_age_index.lower_bound( age_index(start_time,fc::uint128()) );
+      auto itr = my->_age_index.range( age_index(start_time,fc::uint128()), age_index(after_end,fc::uint128()), opts );
       while( itr.valid() )
       {
-          auto key = itr.key();
-          if( key.timestamp > endtime ) 
-          {
-             return invent;
-          }
           invent.push_back( itr.key().message_id );
           ++itr;
       }
@@ -148,6 +157,16 @@ namespace bts { namespace bitchat {
       return my->_cache_by_id.fetch( msg_id );
   } FC_RETHROW_EXCEPTIONS( warn, "", ("msg_id",msg_id) ) }
 
+  fc::optional<encrypted_message> message_cache::try_fetch( const fc::uint128& msg_id )
+  { try {
+      return my->_cache_by_id.try_fetch( msg_id );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("msg_id",msg_id) ) }
+
+  bool message_cache::contains( const fc::uint128& msg_id )
+  { try {
+      return my->_cache_by_id.contains( msg_id );
+  } FC_RETHROW_EXCEPTIONS( warn, "", ("msg_id",msg_id) ) }
+
   fc::time_point message_cache::last_message_timestamp()
   {
       return my->_stats->last_timestamp;
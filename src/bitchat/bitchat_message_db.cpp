@@ -3,10 +3,45 @@
 #include <fc/exception/exception.hpp>
 #include <bts/db/level_pod_map.hpp>
 
+namespace bts { namespace db { namespace detail {
+
+  /**
+   *  Headers are equivalent when their type, received_time, to_key and from_key
+   *  match, so those fields are packed first and the remaining fields follow
+   *  in order to recover the full header from the key.
+   */
+  template<>
+  struct key_packer<bts::bitchat::message_header,false,false>
+  {
+     static void pack( std::vector<char>& out, const bts::bitchat::message_header& h )
+     {
+        pack_key( out, h.type );
+        pack_key( out, h.received_time );
+        pack_key( out, h.to_key );
+        pack_key( out, h.from_key );
+        pack_key( out, h.digest );
+        pack_key( out, h.status );
+        pack_key( out, h.from_sig );
+        pack_key( out, h.from_sig_time );
+        pack_key( out, h.ack_time );
+        pack_key( out, h.read_mark );
+     }
+     static void unpack( key_stream& ds, bts::bitchat::message_header& h )
+     {
+        unpack_key( ds, h.type );
+        unpack_key( ds, h.received_time );
+        unpack_key( ds, h.to_key );
+        unpack_key( ds, h.from_key );
+        unpack_key( ds, h.digest );
+        unpack_key( ds, h.status );
+        unpack_key( ds, h.from_sig );
+        unpack_key( ds, h.from_sig_time );
+        unpack_key( ds, h.ack_time );
+        unpack_key( ds, h.read_mark );
+     }
+  };
 
-
-
-
+} } } // bts::db::detail
 
 namespace bts { namespace bitchat {
   
@@ -38,6 +73,28 @@ namespace bts { namespace bitchat {
        public:
           db::level_pod_map<message_header,uint32_t>    _index;
           db::level_pod_map<fc::uint256,std::vector<char> > _digest_to_data;
+
+          /**
+           *  Removes the stored header that is equivalent to h, which may differ 
+           *  from h in fields that are not used for equivalence.
+           */
+          void remove_equivalent( const message_header& h )
+          {
+             message_header start;
+             start.type          = h.type;
+             start.received_time = h.received_time;
+             start.to_key        = h.to_key;
+             start.from_key      = h.from_key;
+             auto itr = _index.lower_bound( start );
+             if( itr.valid() )
+             {
+                auto cur = itr.key();
+                if( !(cur < h) && !(h < cur) )
+                {
+                   _index.remove( cur );
+                }
+             }
+          }
      };
 
   } // namespace detail
@@ -52,15 +109,15 @@ namespace bts { namespace bitchat {
   void message_db::open( const fc::path& dbdir, const fc::uint512& key, bool create )
   { try {
         fc::create_directories(dbdir);
-        my->_index.open(dbdir/"index");
-        my->_digest_to_data.open(dbdir/"digest_to_data");
+        my->_index.open( dbdir/"index", true, db::scan_profile );
+        my->_digest_to_data.open( dbdir/"digest_to_data", true, db::point_lookup_profile );
   } FC_RETHROW_EXCEPTIONS( warn, "", ("dir", dbdir)("key",key)("create",create)) }
 
   message_header message_db::store_message(const decrypted_message& msg,
                                            const message_header* previous_msg_header )
   { try {
       if (previous_msg_header)
-        my->_index.remove(*previous_msg_header);
+        my->remove_equivalent(*previous_msg_header);
   
       FC_ASSERT( msg.from_sig    );
       FC_ASSERT( msg.from_key    );
@@ -84,7 +141,7 @@ namespace bts { namespace bitchat {
   //remove entire message (msg_header and message contents)
   void message_db::remove_message(const message_header& msg_header)
   {
-      my->_index.remove(msg_header);    
+      my->remove_equivalent(msg_header);    
       my->_digest_to_data.remove(msg_header.digest);
   }
 
@@ -92,12 +149,13 @@ namespace bts { namespace bitchat {
   //used for equivalence, you need to first remove the unmodified form of the msg_header.
   void message_db::store_message_header(const message_header& msg_header)
   {
+      my->remove_equivalent(msg_header);
       my->_index.store(msg_header,0);
   } 
 
   void message_db::remove_message_header(const message_header& msg_header)
   {
-      my->_index.remove(msg_header);
+      my->remove_equivalent(msg_header);
   } 
 
   std::vector<message_header>  message_db::fetch_headers( private_message_type t, 
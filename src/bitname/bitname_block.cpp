@@ -11,9 +11,16 @@ namespace bts { namespace bitname {
 
   name_id_type  name_header::id()const
   {
-    name_id_type::encoder enc;
-    fc::raw::pack(enc,*this);
-    return enc.result();
+    return _id.get( [this]() -> name_id_type {
+       name_id_type::encoder enc;
+       fc::raw::pack(enc,*this);
+       return enc.result();
+    } );
+  }
+
+  void name_header::reset_id()
+  {
+    _id.reset();
   }
 
   short_name_id_type name_header::short_id()const
@@ -871,27 +871,23 @@ namespace bts { namespace bitname {
    */
   fc::optional<name_record> name_channel::lookup_name( const std::string& name )
   { try  {
-        try {
-          name_trx     last_trx = my->_name_db.fetch_trx( name_hash( name ) );
-          name_record  name_rec;
-
-          name_rec.last_update = last_trx.utc_sec;
-          name_rec.master_key  = last_trx.master_key;
-          name_rec.active_key  = last_trx.active_key;
-          name_rec.age         = last_trx.age;
-          name_rec.repute      = my->_name_db.fetch_repute( name_hash(name) ); //last_trx.repute_points;
-          name_rec.revoked     = last_trx.master_key == fc::ecc::public_key_data();
-          name_rec.name_hash   = fc::to_hex((char*)&last_trx.name_hash, sizeof(last_trx.name_hash));
-          name_rec.name        = name;
-
-          return name_rec;
-        }
-        catch ( const fc::key_not_found_exception& )
-        {
-          // expected, convert to null optional, all other errors should be
-          // thrown up the chain
-        }
-        return fc::optional<name_record>();
+        // unknown names are expected and come back null, all other errors are thrown
+        auto last_trx_opt = my->_name_db.try_fetch_trx( name_hash( name ) );
+        if( !last_trx_opt ) return fc::optional<name_record>();
+
+        const name_trx& last_trx = *last_trx_opt;
+        name_record  name_rec;
+
+        name_rec.last_update = last_trx.utc_sec;
+        name_rec.master_key  = last_trx.master_key;
+        name_rec.active_key  = last_trx.active_key;
+        name_rec.age         = last_trx.age;
+        name_rec.repute      = my->_name_db.fetch_repute( name_hash(name) ); //last_trx.repute_points;
+        name_rec.revoked     = last_trx.master_key == fc::ecc::public_key_data();
+        name_rec.name_hash   = fc::to_hex((char*)&last_trx.name_hash, sizeof(last_trx.name_hash));
+        name_rec.name        = name;
+
+        return name_rec;
   } FC_RETHROW_EXCEPTIONS( warn, "name: ${name}", ("name",name) ) }
   uint32_t      name_channel::get_head_block_number()const
   {
@@ -65,19 +65,48 @@ namespace bts { namespace bitname {
              std::unordered_map<fc::sha224,uint32_t>   _id_to_block_num;
 
 
+             /** @return the most recent location of name, null if it was never registered */
+             fc::optional<name_location> try_find_name( uint64_t name )
+             {
+               auto name_locs = _name_hash_to_locs.try_fetch( name );
+               if( !name_locs ) return fc::optional<name_location>();
+               FC_ASSERT( name_locs->size() != 0 );
+               return name_locs->back();
+             }
+
              name_location find_name( uint64_t name )
              {
-               auto name_locs = _name_hash_to_locs.fetch( name );
-               FC_ASSERT( name_locs.size() != 0 );
-               return name_locs.back();
+               auto loc = try_find_name( name );
+               if( !loc )
+               {
+                  FC_THROW_EXCEPTION( key_not_found_exception, "unknown name hash ${name}", ("name",name) );
+               }
+               return *loc;
+             }
+
+             name_trx fetch_trx( const name_location& name_loc, uint64_t name_hash )
+             {
+                if( name_loc.trx_num != max_trx_num )
+                {
+                  auto name_trxs = _block_num_to_name_trxs.fetch( name_loc.block_num );
+                  FC_ASSERT( name_trxs.size() > name_loc.trx_num, "trx_num: ${num}", ("num",name_loc.trx_num) );
+                  FC_ASSERT( name_trxs[name_loc.trx_num].name_hash == name_hash );
+                  return name_trxs[name_loc.trx_num];
+                }
+                else
+                {
+                  auto name_head = _block_num_to_header.fetch( name_loc.block_num );
+                  FC_ASSERT( name_head.name_hash == name_hash );
+                  return name_head;
+                }
              }
 
              void index_trx( const name_location& loc, uint64_t name_hash )
              {
-                auto name_locs_itr = _name_hash_to_locs.find( name_hash );
-                if( name_locs_itr.valid() )
+                auto name_locs_opt = _name_hash_to_locs.try_fetch( name_hash );
+                if( name_locs_opt )
                 {
-                    auto name_locs = name_locs_itr.value();
+                    auto name_locs = *name_locs_opt;
                     name_locs.push_back( loc );
                     _name_hash_to_locs.store( name_hash, name_locs );
                 }
@@ -108,7 +137,11 @@ namespace bts { namespace bitname {
                     auto itr = _block_num_to_header.begin();
                     while( itr.valid() )
                     {
-                      push_header_id( itr.value().id() );
+                      // the id is the hash of the packed header, which is exactly what is stored
+                      auto packed = itr.raw_value();
+                      name_id_type::encoder enc;
+                      enc.write( packed.data(), packed.size() );
+                      push_header_id( enc.result() );
                       ++itr;
                     }
                     // TODO: save to disk
@@ -205,8 +238,10 @@ namespace bts { namespace bitname {
        }
 
        my->_block_num_to_header.open( db_dir / "block_num_to_header" );
-       my->_block_num_to_name_trxs.open( db_dir / "block_num_to_name_trxs" );
-       my->_name_hash_to_locs.open( db_dir / "name_hash_to_locs" );
+       my->_block_num_to_name_trxs.open( db_dir / "block_num_to_name_trxs", true, db::scan_profile );
+       my->_name_hash_to_locs.open( db_dir / "name_hash_to_locs", true, db::point_lookup_profile );
+       my->_block_num_to_header.set_cache_size( BITNAME_RECORD_CACHE_SIZE );
+       my->_name_hash_to_locs.set_cache_size( BITNAME_RECORD_CACHE_SIZE );
 
        my->load_indexes(db_dir);
        my->load_genesis();
@@ -505,20 +540,14 @@ namespace bts { namespace bitname {
 
     name_trx   name_db::fetch_trx( uint64_t name_hash )const
     { try {
-        auto name_loc  = my->find_name( name_hash );
-        if( name_loc.trx_num != max_trx_num )
-        {
-          auto name_trxs = my->_block_num_to_name_trxs.fetch( name_loc.block_num );
-          FC_ASSERT( name_trxs.size() > name_loc.trx_num, "trx_num: ${num}", ("num",name_loc.trx_num) );
-          FC_ASSERT( name_trxs[name_loc.trx_num].name_hash == name_hash );
-          return name_trxs[name_loc.trx_num];
-        }
-        else
-        {
-          auto name_head = my->_block_num_to_header.fetch( name_loc.block_num );
-          FC_ASSERT( name_head.name_hash == name_hash );
-          return name_head;
-        }
+        return my->fetch_trx( my->find_name( name_hash ), name_hash );
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to fetch trx for name hash ${name_hash}", ("name_hash", name_hash ) ) }
+
+    fc::optional<name_trx> name_db::try_fetch_trx( uint64_t name_hash )const
+    { try {
+        auto name_loc = my->try_find_name( name_hash );
+        if( !name_loc ) return fc::optional<name_trx>();
+        return my->fetch_trx( *name_loc, name_hash );
     } FC_RETHROW_EXCEPTIONS( warn, "unable to fetch trx for name hash ${name_hash}", ("name_hash", name_hash ) ) }
 
     uint32_t name_db::fetch_repute( uint64_t name_hash )const
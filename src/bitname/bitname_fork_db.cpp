@@ -85,11 +85,11 @@ namespace bts { namespace bitname {
 
         void add_next( name_id_type prev, name_id_type next )
         { try {
-           auto nexts_itr = _nexts.find(prev);
+           auto nexts_opt = _nexts.try_fetch(prev);
            std::unordered_set<name_id_type> nexts;
-           if( nexts_itr.valid() )
+           if( nexts_opt )
            {
-             nexts = nexts_itr.value();
+             nexts = std::move( *nexts_opt );
            }
            
            if( nexts.insert(next).second )
@@ -122,11 +122,11 @@ namespace bts { namespace bitname {
                auto cur_meta = _headers.fetch( cur_id );
                FC_ASSERT( cur_meta.height > 0 );
 
-               auto itr = _nexts.find(cur_id);
+               auto next_set_opt = _nexts.try_fetch(cur_id);
                bool has_next = false;
-               if( itr.valid() )
+               if( next_set_opt )
                {
-                  auto next_set = itr.value();
+                  const auto& next_set = *next_set_opt;
                   for( auto itr = next_set.begin(); itr != next_set.end(); ++itr )
                   {
                      auto next_meta             = _headers.fetch( *itr );
@@ -177,11 +177,11 @@ namespace bts { namespace bitname {
      {
         fc::create_directories( db_dir );
      }
-     my->_headers.open( db_dir / "headers", create );
-     my->_blocks.open( db_dir / "blocks", create );
+     my->_headers.open( db_dir / "headers", create, db::point_lookup_profile );
+     my->_blocks.open( db_dir / "blocks", create, db::point_lookup_profile );
      my->_forks.open( db_dir / "forks", create );
-     my->_nexts.open( db_dir / "nexts", create );
-     my->_unknown.open( db_dir / "unknown", create );
+     my->_nexts.open( db_dir / "nexts", create, db::point_lookup_profile );
+     my->_unknown.open( db_dir / "unknown", create, db::point_lookup_profile );
 
      cache_block( create_genesis_block() );
 
@@ -214,10 +214,10 @@ namespace bts { namespace bitname {
         my->_headers.store(id,meta);
         return;
       }
-      auto prev_meta_itr = my->_headers.find( head.prev );
-      if( prev_meta_itr.valid() )
+      auto prev_meta_opt = my->_headers.try_fetch( head.prev );
+      if( prev_meta_opt )
       {
-         auto prev_meta = prev_meta_itr.value();
+         auto prev_meta = *prev_meta_opt;
          if( prev_meta.height != -1 )
          {
              meta.height           = prev_meta.height + 1;
@@ -235,8 +235,7 @@ namespace bts { namespace bitname {
       }
       my->_headers.store( id, meta );
 
-      auto unknown_itr = my->_unknown.find(id);
-      if( unknown_itr.valid() )
+      if( my->_unknown.contains(id) )
       {
           my->_unknown.remove( id );
           if( meta.height )
@@ -282,15 +281,7 @@ namespace bts { namespace bitname {
        return name_block(head);
      }
 
-     try {
-        // TODO: verify that _blocks.fetch() throws key_not_found exception
-        // if no block is known for id.
-        return my->_blocks.fetch(id);
-     } 
-     catch ( const fc::key_not_found_exception& e )
-     {
-       return fc::optional<name_block>();
-     }
+     return my->_blocks.try_fetch(id);
   } FC_RETHROW_EXCEPTIONS( warn, "", ("id",id) ) }
 
   void fork_db::set_valid( const name_id_type& blk_id, bool is_valid )
@@ -74,9 +74,11 @@ namespace bts { namespace bitname {
                  _mine_time[thread_num] = fc::time_point::now() - fc::seconds(10);
                }
                b.utc_sec = _mine_time[thread_num];
+               b.reset_id();
                for( uint32_t nonce = thread_num; version >= _block_version && nonce < max_nonce; nonce += DEFAULT_MINING_THREADS )
                {
                    b.nonce   = nonce;
+                   b.reset_id();
                
                    uint64_t header_difficulty = b.difficulty();
 
@@ -107,6 +109,7 @@ namespace bts { namespace bitname {
                }
                _mine_time[thread_num] += 1;
                b.utc_sec = _mine_time[thread_num];
+               b.reset_id();
 
                do {
                    fc::usleep( fc::microseconds( 5000 + 1000000 * (1-_cur_effort) ) );
@@ -133,6 +136,7 @@ namespace bts { namespace bitname {
            FC_ASSERT( _callback_del != nullptr ); // no point in mining if there is no one to tell when we find the result
 
            _cur_block.trxs_hash = _cur_block.calc_trxs_hash();
+           _cur_block.reset_id();
 
            //uint64_t block_diff = _cur_block.calc_difficulty();
            //name_pow_target = mini_pow_difficulty(min_name_pow);
@@ -0,0 +1,48 @@
+#include <bts/blockchain/address_filter.hpp>
+#include <bts/config.hpp>
+
+namespace bts { namespace blockchain {
+
+  namespace 
+  {
+     /** filters are shared with other nodes, so the bytes are read the same on every host */
+     uint32_t read_little_endian( const char* p )
+     {
+        return  uint32_t(uint8_t(p[0]))        | (uint32_t(uint8_t(p[1])) << 8) |
+               (uint32_t(uint8_t(p[2])) << 16) | (uint32_t(uint8_t(p[3])) << 24);
+     }
+
+     /** calls f with each bit position of a in a filter of bit_count bits */
+     template<typename Functor>
+     void for_each_bit( const address& a, uint32_t bit_count, Functor&& f )
+     {
+        // the checksum in the last 4 bytes and the zero bits up front are skipped
+        uint32_t h1 = read_little_endian( &a.addr.data[4] );
+        uint32_t h2 = read_little_endian( &a.addr.data[8] );
+        for( uint32_t i = 0; i < BITSHARE_ADDRESS_FILTER_HASHES; ++i )
+        {
+           f( (h1 + i * h2) % bit_count );
+        }
+     }
+  }
+
+  address_filter::address_filter( uint32_t expected_count )
+  :bits( (expected_count * BITSHARE_ADDRESS_FILTER_BITS_PER_ADDRESS + 7) / 8 + 1 )
+  {
+  }
+
+  void address_filter::insert( const address& a )
+  {
+     if( bits.size() == 0 ) bits.resize( 1 );
+     for_each_bit( a, bits.size() * 8, [&]( uint32_t bit ) { bits[bit/8] |= char(1 << (bit%8)); } );
+  }
+
+  bool address_filter::may_contain( const address& a )const
+  {
+     if( bits.size() == 0 ) return false;
+     bool found = true;
+     for_each_bit( a, bits.size() * 8, [&]( uint32_t bit ) { found &= (bits[bit/8] & (1 << (bit%8))) != 0; } );
+     return found;
+  }
+
+} } // bts::blockchain
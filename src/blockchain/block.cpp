@@ -47,6 +47,17 @@ namespace bts { namespace blockchain  {
   }
 
 
+  uint160 full_block::calculate_merkle_root()const
+  {
+     return merkle_tree( trx_ids ).mroot;
+  }
+
+  bool verify_trx_branch( const block_header& header, const transaction_id_type& trx_id, const merkle_branch& branch )
+  {
+     return branch.mid_states.size() > 0 && branch.mid_states[0] == trx_id
+            && branch.calculate_root() == header.trx_mroot;
+  }
+
   uint160 trx_block::calculate_merkle_root()const
   {
      if( trxs.size() == 0 ) return uint160();
@@ -82,9 +93,16 @@ namespace bts { namespace blockchain  {
    */
   block_id_type block_header::id()const
   {
-     fc::sha512::encoder enc;
-     fc::raw::pack( enc, *this );
-     return small_hash( enc.result() );
+     return _id.get( [this]() -> block_id_type {
+        fc::sha512::encoder enc;
+        fc::raw::pack( enc, *this );
+        return small_hash( enc.result() );
+     } );
+  }
+
+  void block_header::reset_id()
+  {
+     _id.reset();
   }
 
 } } // bts::blockchain
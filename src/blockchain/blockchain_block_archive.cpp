@@ -0,0 +1,209 @@
+#include <bts/blockchain/blockchain_block_archive.hpp>
+#include <fc/interprocess/file_mapping.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/log/logger.hpp>
+
+#include <fstream>
+#include <cstdio>
+
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+namespace bts { namespace blockchain {
+
+  namespace detail
+  {
+     /** flushes f and waits for its data to reach stable storage */
+     static void sync_file( FILE* f )
+     {
+        FC_ASSERT( fflush( f ) == 0, "unable to flush block archive" );
+#ifndef WIN32
+        FC_ASSERT( fsync( fileno( f ) ) == 0, "unable to sync block archive" );
+#else
+        FC_ASSERT( _commit( _fileno( f ) ) == 0, "unable to sync block archive" );
+#endif
+     }
+
+     class block_archive_impl
+     {
+        public:
+           fc::path                              _data_file;
+           fc::path                              _index_file;
+
+           /** _offsets[n] is where block n starts, the last entry is the end of the data */
+           std::vector<uint64_t>                 _offsets;
+
+           FILE*                                 _data_out;
+           FILE*                                 _index_out;
+
+           /** maps the data file up to _offsets.back(), remapped after it grows */
+           mutable std::unique_ptr<fc::file_mapping>   _mapping;
+           mutable std::unique_ptr<fc::mapped_region>  _region;
+
+           block_archive_impl()
+           :_data_out(nullptr),_index_out(nullptr){}
+
+           ~block_archive_impl()
+           {
+              close_outputs();
+           }
+
+           void open_outputs()
+           {
+              close_outputs();
+              _data_out  = fopen( _data_file.generic_string().c_str(), "ab" );
+              _index_out = fopen( _index_file.generic_string().c_str(), "ab" );
+              FC_ASSERT( _data_out && _index_out, "unable to open block archive for writing" );
+           }
+
+           void close_outputs()
+           {
+              if( _data_out )  fclose( _data_out );
+              if( _index_out ) fclose( _index_out );
+              _data_out  = nullptr;
+              _index_out = nullptr;
+           }
+
+           void unmap()
+           {
+              _region.reset();
+              _mapping.reset();
+           }
+
+           const char* data()const
+           {
+              if( !_region )
+              {
+                 _mapping.reset( new fc::file_mapping( _data_file.generic_string().c_str(), fc::read_only ) );
+                 _region.reset( new fc::mapped_region( *_mapping, fc::read_only, 0, _offsets.back() ) );
+              }
+              return (const char*)_region->get_address();
+           }
+     };
+  } // namespace detail
+
+  block_archive::block_archive()
+  :my( new detail::block_archive_impl() )
+  {
+  }
+
+  block_archive::~block_archive()
+  {}
+
+  void block_archive::open( const fc::path& dir )
+  { try {
+     fc::create_directories( dir );
+     my->_data_file  = dir / "blocks.dat";
+     my->_index_file = dir / "blocks.idx";
+
+     uint64_t data_size = fc::exists( my->_data_file ) ? fc::file_size( my->_data_file ) : 0;
+
+     my->_offsets.clear();
+     my->_offsets.push_back( 0 );
+     if( fc::exists( my->_index_file ) )
+     {
+        uint64_t index_size = fc::file_size( my->_index_file );
+        std::vector<uint64_t> ends( index_size / sizeof(uint64_t) );
+        if( ends.size() )
+        {
+           std::ifstream in( my->_index_file.generic_string().c_str(), std::ios::binary );
+           in.read( (char*)ends.data(), ends.size() * sizeof(uint64_t) );
+           FC_ASSERT( in.good(), "unable to read block archive index" );
+        }
+        // entries written after a crash lost them may read back as zeros
+        for( auto itr = ends.begin(); itr != ends.end() && *itr > my->_offsets.back() && *itr <= data_size; ++itr )
+        {
+           my->_offsets.push_back( *itr );
+        }
+        if( (my->_offsets.size()-1) * sizeof(uint64_t) != index_size )
+        {
+           wlog( "dropping invalid or partially written block archive index entries" );
+           fc::resize_file( my->_index_file, (my->_offsets.size()-1) * sizeof(uint64_t) );
+        }
+     }
+     if( data_size != my->_offsets.back() )
+     {
+        wlog( "dropping ${n} bytes of unindexed block archive data", ("n",data_size - my->_offsets.back()) );
+        fc::resize_file( my->_data_file, my->_offsets.back() );
+     }
+
+     my->open_outputs();
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to open block archive ${dir}", ("dir",dir) ) }
+
+  void block_archive::close()
+  {
+     my->unmap();
+     my->close_outputs();
+  }
+
+  uint32_t block_archive::size()const
+  {
+     return my->_offsets.size() - 1;
+  }
+
+  void block_archive::append( const trx_block& b )
+  {
+     append( std::vector<trx_block>( 1, b ) );
+  }
+
+  void block_archive::append( const std::vector<trx_block>& blocks )
+  { try {
+     if( !blocks.size() ) return;
+
+     std::vector<uint64_t> ends;
+     ends.reserve( blocks.size() );
+     uint64_t end = my->_offsets.back();
+     for( auto itr = blocks.begin(); itr != blocks.end(); ++itr )
+     {
+        FC_ASSERT( itr->block_num == size() + ends.size(), "blocks must be archived in order",
+                   ("next",size() + ends.size())("block_num",itr->block_num) );
+        auto packed = fc::raw::pack( *itr );
+        FC_ASSERT( fwrite( packed.data(), 1, packed.size(), my->_data_out ) == packed.size(), "unable to write block data" );
+        end += packed.size();
+        ends.push_back( end );
+     }
+     detail::sync_file( my->_data_out );
+
+     size_t index_size = ends.size() * sizeof(uint64_t);
+     FC_ASSERT( fwrite( (const char*)ends.data(), 1, index_size, my->_index_out ) == index_size, "unable to write block index" );
+     FC_ASSERT( fflush( my->_index_out ) == 0, "unable to write block index" );
+
+     my->_offsets.insert( my->_offsets.end(), ends.begin(), ends.end() );
+     my->unmap();
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to archive blocks starting at ${n}", ("n",size()) ) }
+
+  void block_archive::truncate( uint32_t block_num )
+  { try {
+     if( block_num >= size() ) return;
+
+     my->unmap();
+     my->close_outputs();
+
+     my->_offsets.resize( block_num + 1 );
+     fc::resize_file( my->_index_file, block_num * sizeof(uint64_t) );
+     fc::resize_file( my->_data_file, my->_offsets.back() );
+
+     my->open_outputs();
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to truncate block archive at ${n}", ("n",block_num) ) }
+
+  std::pair<const char*,size_t> block_archive::fetch_packed( uint32_t block_num )const
+  { try {
+     FC_ASSERT( block_num < size(), "block is not archived", ("archived",size()) );
+     uint64_t begin = my->_offsets[block_num];
+     return std::make_pair( my->data() + begin, size_t(my->_offsets[block_num+1] - begin) );
+  } FC_RETHROW_EXCEPTIONS( warn, "block ${n}", ("n",block_num) ) }
+
+  trx_block block_archive::fetch( uint32_t block_num )const
+  { try {
+     auto packed = fetch_packed( block_num );
+     fc::datastream<const char*> ds( packed.first, packed.second );
+     trx_block b;
+     fc::raw::unpack( ds, b );
+     return b;
+  } FC_RETHROW_EXCEPTIONS( warn, "block ${n}", ("n",block_num) ) }
+
+} } // bts::blockchain
@@ -241,8 +241,8 @@ namespace bts { namespace blockchain {
                   {
                      // TODO DB queries are far more expensive, and therefore must be rationed and potentialy
                      // require a proof of work paying us to fetch them
-                     auto tx_num = _db->fetch_trx_num( *itr );
-                     reply.trxs.push_back( _db->fetch_trx(tx_num) );
+                     auto tx_num = _db->try_fetch_trx_num( *itr );
+                     if( tx_num ) reply.trxs.push_back( _db->fetch_trx( *tx_num ) );
                   }
                   else
                   {
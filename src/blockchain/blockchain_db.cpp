@@ -2,21 +2,32 @@
 #include <bts/blockchain/trx_validation_state.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
 #include <bts/blockchain/blockchain_market_db.hpp>
+#include <bts/blockchain/blockchain_unspent_db.hpp>
+#include <bts/blockchain/blockchain_block_archive.hpp>
 #include <bts/blockchain/asset.hpp>
 #include <leveldb/db.h>
+#include <leveldb/write_batch.h>
 #include <bts/db/level_pod_map.hpp>
 #include <bts/db/level_map.hpp>
 #include <fc/io/enum_type.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/interprocess/mmap_struct.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/thread/future.hpp>
 
 #include <fc/filesystem.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/io/json.hpp>
 
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <sstream>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <thread>
 
 
 struct trx_stat
@@ -31,16 +42,170 @@ bool operator < ( const trx_stat& a, const trx_stat& b )
 }
 FC_REFLECT( trx_stat, (trx_idx)(eval) )
 
+namespace bts { namespace blockchain { namespace detail {
+
+   /** an output of a prior block that was spent by the block being undone */
+   struct undo_spent_output
+   {
+      undo_spent_output(){}
+      undo_spent_output( const output_reference& r, const unspent_output& o )
+      :ref(r),output(o){}
+
+      output_reference  ref;
+      unspent_output    output;
+   };
+
+   /** a transaction stored by the block being undone */
+   struct undo_trx
+   {
+      undo_trx():output_count(0){}
+      undo_trx( const uint160& i, uint16_t c )
+      :id(i),output_count(c){}
+
+      uint160   id;
+      uint16_t  output_count;
+   };
+
+   /**
+    *  Written for every block before any of the changes the block makes so 
+    *  that the block can be removed from the head of the chain, or a push
+    *  that was interrupted can be rolled back, without scanning the chain.  
+    *  The block itself is kept so that open() can store it again if the
+    *  writes it made to the other tables were lost.
+    *
+    *  Orders removed from the market are not recorded because they are 
+    *  placed again from the restored outputs.
+    */
+   struct block_undo
+   {
+      block_id_type                     block_id;
+      trx_block                         block;
+      std::vector<undo_trx>             trxs;
+      std::vector<undo_spent_output>    spent;
+      std::vector<market_order>         new_bids;
+      std::vector<market_order>         new_asks;
+   };
+
+   /** a transaction included in a snapshot, spends after the snapshot head are cleared */
+   struct snapshot_trx
+   {
+      snapshot_trx(){}
+      snapshot_trx( const trx_num& n, const meta_trx& t )
+      :num(n),trx(t){}
+
+      trx_num   num;
+      meta_trx  trx;
+   };
+
+   /**
+    *  The chain state as of head, everything needed to push the next block.
+    *  The unspent outputs and market orders are derived from trxs, which hold
+    *  every trx with an unspent output and every trx of the head block in
+    *  trx_num order.  The head block trxs let an import check the trxs
+    *  against the trx_mroot of the head.
+    *
+    *  The file is the packed snapshot followed by its sha256.
+    */
+   struct chain_snapshot
+   {
+      block_header               head;
+      std::vector<snapshot_trx>  trxs;
+   };
+
+   /** import_snapshot() builds the new chain here and renames it over the chain once complete */
+   inline fc::path import_path( const fc::path& dir )   { return fc::path( dir.generic_string() + ".import" );   }
+   /** where the chain replaced by an import is moved while the import takes its place */
+   inline fc::path replaced_path( const fc::path& dir ) { return fc::path( dir.generic_string() + ".replaced" ); }
+
+   /**
+    *  If the process stopped after the chain was moved aside by an import but
+    *  before the imported chain took its place, finish the import.  Anything
+    *  else left behind by an interrupted import is discarded.
+    */
+   static void recover_interrupted_import( const fc::path& dir )
+   {
+      if( !fc::exists( dir ) && fc::exists( replaced_path( dir ) ) )
+      {
+         wlog( "finishing the interrupted snapshot import into ${dir}", ("dir",dir) );
+         if( fc::exists( import_path( dir ) ) ) fc::rename( import_path( dir ), dir );
+         else                                   fc::rename( replaced_path( dir ), dir );
+      }
+      if( fc::exists( replaced_path( dir ) ) ) fc::remove_all( replaced_path( dir ) );
+      if( fc::exists( import_path( dir ) ) )   fc::remove_all( import_path( dir ) );
+   }
+
+   static chain_snapshot read_snapshot( const fc::path& file )
+   {
+      std::vector<char> packed( fc::file_size( file ) );
+      std::ifstream in( file.generic_string().c_str(), std::ios::binary );
+      in.read( packed.data(), packed.size() );
+      FC_ASSERT( in.good(), "unable to read snapshot" );
+
+      FC_ASSERT( packed.size() > sizeof(fc::sha256), "snapshot is truncated" );
+      size_t     body = packed.size() - sizeof(fc::sha256);
+      fc::sha256 checksum;
+      memcpy( (char*)&checksum, packed.data() + body, sizeof(checksum) );
+      FC_ASSERT( fc::sha256::hash( packed.data(), body ) == checksum, "snapshot is corrupt" );
+
+      chain_snapshot snap;
+      fc::datastream<const char*> ds( packed.data(), body );
+      fc::raw::unpack( ds, snap );
+      return snap;
+   }
+
+} } } // bts::blockchain::detail
+
+FC_REFLECT( bts::blockchain::detail::snapshot_trx, (num)(trx) )
+FC_REFLECT( bts::blockchain::detail::chain_snapshot, (head)(trxs) )
+FC_REFLECT( bts::blockchain::detail::undo_spent_output, (ref)(output) )
+FC_REFLECT( bts::blockchain::detail::undo_trx, (id)(output_count) )
+FC_REFLECT( bts::blockchain::detail::block_undo, (block_id)(block)(trxs)(spent)(new_bids)(new_asks) )
+
 namespace bts { namespace blockchain {
     namespace ldb = leveldb;
+
+    /** @return the address that can claim out, if it is owned by a single address */
+    static fc::optional<address> output_owner( const trx_output& out )
+    {
+       fc::optional<address> owner;
+       switch( out.claim_func )
+       {
+          case claim_by_signature: owner = out.as<claim_by_signature_output>().owner;   break;
+          case claim_by_bid:       owner = out.as<claim_by_bid_output>().pay_address;   break;
+          case claim_by_long:      owner = out.as<claim_by_long_output>().pay_address;  break;
+          case claim_by_cover:     owner = out.as<claim_by_cover_output>().owner;       break;
+          default: break;
+       }
+       return owner;
+    }
+
     namespace detail  
     { 
+      enum checkpoint_state
+      {
+         checkpoints_trusted      = 0,
+         /** a block contradicted a checkpoint, every block is fully validated */
+         checkpoints_untrusted    = 1,
+         /** the blocks above verified are being popped to be validated again */
+         checkpoints_revalidating = 2
+      };
+
+      struct checkpoint_status
+      {
+         checkpoint_status()
+         :state(checkpoints_trusted),verified(INVALID_BLOCK_NUM){}
+
+         uint32_t state;
+         /** the last block that was fully validated or matched a checkpoint */
+         uint32_t verified;
+      };
       
       // TODO: .01 BTC update private members to use _member naming convention
       class blockchain_db_impl
       {
          public:
-            blockchain_db_impl(){}
+            blockchain_db_impl()
+            :_prune_depth(0),_compacted_blocks(0),_index_addresses(false){}
 
             //std::unique_ptr<ldb::DB> blk_id2num;  // maps blocks to unique IDs
             bts::db::level_map<block_id_type,uint32_t>          blk_id2num;
@@ -48,30 +213,203 @@ namespace bts { namespace blockchain {
             bts::db::level_map<trx_num,meta_trx>                meta_trxs;
             bts::db::level_map<uint32_t,block_header>           blocks;
             bts::db::level_map<uint32_t,std::vector<uint160> >  block_trxs; 
+            bts::db::level_map<uint32_t,block_undo>             undo_db;
+            bts::db::level_map<address_output_key,output_reference> address_index;
+            bts::db::level_map<uint32_t,address_filter>         block_filters;
+            /** the blocks replaced by a fork switch that has not finished, restored by open() */
+            bts::db::level_map<uint32_t,trx_block>              fork_journal;
 
             market_db                                           _market_db;
+            unspent_db                                          _unspent;
+
+            /**
+             *  a read cache of blocks that can no longer be popped, they stay in
+             *  leveldb but are served from here without leveldb lookups
+             */
+            block_archive                                       _archive;
+
+            /** 0 unless pruning is enabled */
+            uint32_t                                            _prune_depth;
+            /** every block below this one has been pruned */
+            fc::mmap_struct<uint32_t>                           _pruned_blocks;
+            /** the pruned keys below this block have been compacted */
+            uint32_t                                            _compacted_blocks;
+
+            bool                                                _index_addresses;
+
+            /** the directory the chain was opened in */
+            fc::path                                            _dir;
+
+            std::map<uint32_t,block_id_type>                    _checkpoints;
+            /** kept across restarts once a block did not match its checkpoint */
+            fc::mmap_struct<checkpoint_status>                  _checkpoint_status;
+
+            /** shared by every evaluation so each trx is only recovered once */
+            signature_cache                                     _sig_cache;
+
+            /** signature recovery and order matching are spread across these */
+            std::vector< std::unique_ptr<fc::thread> >          _worker_threads;
 
             /** cache this information because it is required in many calculations  */
             trx_block                                           head_block;
             block_id_type                                       head_block_id;
 
-            void mark_spent( const output_reference& o, const trx_num& intrx, uint16_t in )
+            /**
+             *  Every change made by a block is gathered here first so that the
+             *  block can be written with a single batch per table.  Spent outputs
+             *  are flagged on the cached meta_trx so each referenced transaction
+             *  is read and written at most once per block.
+             */
+            struct pending_block
             {
-               auto tid    = trx_id2num.fetch( o.trx_hash );
-               meta_trx   mtrx   = meta_trxs.fetch( tid );
+               std::map<trx_num,meta_trx>              meta_trxs;
+               std::unordered_map<uint160,trx_num>     trx_id2num;
+               /** trx_num of the transactions loaded by prefetch_sources() */
+               std::unordered_map<uint160,trx_num>     sources;
+               block_undo                              undo;
+               ldb::WriteBatch                         address_index;
+            };
+
+            /**
+             *  Loads every transaction with an output spent by trxs into pend once,
+             *  reading them in key order so that the reads walk meta_trxs 
+             *  sequentially instead of seeking once per input.  The trx_num of each
+             *  source is taken from the unspent index, outputs that are not in it
+             *  are left for fetch_pending() to resolve.
+             */
+            void prefetch_sources( pending_block& pend, const std::vector<signed_transaction>& trxs )
+            {
+               std::set<trx_num> nums;
+               for( auto trx = trxs.begin(); trx != trxs.end(); ++trx )
+               {
+                  for( auto in = trx->inputs.begin(); in != trx->inputs.end(); ++in )
+                  {
+                     const unspent_output* unspent = _unspent.find( in->output_ref );
+                     if( !unspent ) continue;
+                     if( pend.sources.insert( std::make_pair( in->output_ref.trx_hash, unspent->source ) ).second )
+                     {
+                        nums.insert( unspent->source );
+                     }
+                  }
+               }
+               for( auto itr = nums.begin(); itr != nums.end(); ++itr )
+               {
+                  pend.meta_trxs[*itr] = meta_trxs.fetch( *itr );
+               }
+            }
+
+            /**
+             *  @return the meta_trx for trx_id from the pending block, loading it
+             *          from the database the first time it is referenced.
+             */
+            meta_trx& fetch_pending( pending_block& pend, const uint160& trx_id, trx_num* num = nullptr )
+            {
+               trx_num tn;
+               auto id_itr  = pend.trx_id2num.find( trx_id );
+               auto src_itr = pend.sources.find( trx_id );
+               if( id_itr != pend.trx_id2num.end() )    tn = id_itr->second;
+               else if( src_itr != pend.sources.end() ) tn = src_itr->second;
+               else                                     tn = trx_id2num.fetch( trx_id );
+               if( num ) *num = tn;
+
+               auto itr = pend.meta_trxs.find( tn );
+               if( itr == pend.meta_trxs.end() )
+               {
+                  itr = pend.meta_trxs.insert( std::make_pair( tn, meta_trxs.fetch( tn ) ) ).first;
+               }
+               return itr->second;
+            }
+
+            void mark_spent( pending_block& pend, const output_reference& o, const trx_num& intrx, uint16_t in )
+            {
+               trx_num   source;
+               meta_trx& mtrx = fetch_pending( pend, o.trx_hash, &source );
                FC_ASSERT( mtrx.meta_outputs.size() > o.output_idx );
 
                mtrx.meta_outputs[o.output_idx].trx_id    = intrx;
                mtrx.meta_outputs[o.output_idx].input_num = in;
 
-               meta_trxs.store( tid, mtrx );
-               remove_market_orders( o );
+               // outputs created earlier in the same block go away with the block
+               if( source.block_num != intrx.block_num )
+               {
+                  pend.undo.spent.push_back( undo_spent_output( o, unspent_output( mtrx.outputs[o.output_idx], source ) ) );
+               }
+
+               remove_market_orders( o, mtrx.outputs[o.output_idx] );
             }
 
+            /**
+             *  The number of blocks covered by address_index is kept in it as the
+             *  key of the null address, so it is written in the same batch as the
+             *  entries it describes.  If it matches the chain the index is current.
+             *
+             *  @return INVALID_BLOCK_NUM if the index has never been built
+             */
+            uint32_t address_index_blocks()
+            {
+               auto itr = address_index.begin();
+               if( itr.valid() && itr.key().owner == address() ) return itr.key().source.block_num;
+               return INVALID_BLOCK_NUM;
+            }
 
-            void remove_market_orders( const output_reference& o )
+            void set_address_index_blocks( uint32_t blocks, ldb::WriteBatch& batch )
+            {
+               auto itr = address_index.begin();
+               if( itr.valid() && itr.key().owner == address() ) address_index.remove( itr.key(), batch );
+               address_index.store( address_output_key( address(), trx_num( blocks, 0 ), 0 ), output_reference(), batch );
+            }
+
+            /** stores or removes the address index entries of every output of trx */
+            void index_addresses( const uint160& trx_id, const trx_num& tn, const signed_transaction& trx,
+                                  ldb::WriteBatch& batch, bool store )
+            {
+               for( uint16_t i = 0; i < trx.outputs.size(); ++i )
+               {
+                  auto owner = output_owner( trx.outputs[i] );
+                  if( !owner ) continue;
+
+                  address_output_key key( *owner, tn, i );
+                  if( store ) address_index.store( key, output_reference( trx_id, i ), batch );
+                  else        address_index.remove( key, batch );
+               }
+            }
+
+            /**
+             *  Places the order described by trx_out, if any, recording it in undo
+             *  when it is not null.
+             */
+            void insert_market_orders( const output_reference& o, const trx_output& trx_out, block_undo* undo )
+            {
+               if( trx_out.claim_func == claim_by_bid )
+               {
+                  claim_by_bid_output cbb = trx_out.as<claim_by_bid_output>();
+                  market_order order( cbb.ask_price, o );
+                  if( cbb.is_bid(trx_out.unit) )
+                  {
+                     elog( "Insert Bid: ${bid}", ("bid",order) );
+                     _market_db.insert_bid( order, order_terms( trx_out ) );
+                     if( undo ) undo->new_bids.push_back( order );
+                  }
+                  else
+                  {
+                     elog( "Insert Ask: ${bid}", ("bid",order) );
+                     _market_db.insert_ask( order, order_terms( trx_out ) );
+                     if( undo ) undo->new_asks.push_back( order );
+                  }
+               }
+               else if( trx_out.claim_func == claim_by_long )
+               {
+                 auto cbl = trx_out.as<claim_by_long_output>();
+                 market_order order( cbl.ask_price, o );
+                 elog( "Insert Short Ask: ${bid}", ("bid",order) );
+                 _market_db.insert_bid( order, order_terms( trx_out ) );
+                 if( undo ) undo->new_bids.push_back( order );
+               }
+            }
+
+
+            void remove_market_orders( const output_reference& o, const trx_output& trx_out )
             {
-               auto trx_out = get_output( o );
                if( trx_out.claim_func == claim_by_bid )
                {
                   auto cbb = trx_out.as<claim_by_bid_output>();
@@ -98,71 +436,469 @@ namespace bts { namespace blockchain {
             } FC_RETHROW_EXCEPTIONS( warn, "", ("ref",ref) ) }
             
             /**
-             *   Stores a transaction and updates the spent status of all 
-             *   outputs doing one last check to make sure they are unspent.
+             *  Adds a transaction to the pending block and updates the spent status 
+             *  of all outputs doing one last check to make sure they are unspent.
              */
-            void store( const signed_transaction& t, const trx_num& tn )
+            void store( pending_block& pend, const signed_transaction& t, const trx_num& tn )
             {
-               ilog( "trxid: ${id}   ${tn}\n\n  ${trx}\n\n", ("id",t.id())("tn",tn)("trx",t) );
+               auto trx_id = t.id();
+               ilog( "trxid: ${id}   ${tn}\n\n  ${trx}\n\n", ("id",trx_id)("tn",tn)("trx",t) );
 
-               trx_id2num.store( t.id(), tn ); 
-               meta_trxs.store( tn, meta_trx(t) );
+               pend.trx_id2num[trx_id] = tn;
+               pend.meta_trxs[tn]      = meta_trx(t);
+               pend.undo.trxs.push_back( undo_trx( trx_id, t.outputs.size() ) );
 
                for( uint16_t i = 0; i < t.inputs.size(); ++i )
                {
-                  mark_spent( t.inputs[i].output_ref, tn, i ); 
+                  mark_spent( pend, t.inputs[i].output_ref, tn, i ); 
+                  _unspent.remove( t.inputs[i].output_ref );
                }
                
                for( uint16_t i = 0; i < t.outputs.size(); ++i )
                {
-                  if( t.outputs[i].claim_func == claim_by_bid )
-                  {
-                     claim_by_bid_output cbb = t.outputs[i].as<claim_by_bid_output>();
-                     if( cbb.is_bid(t.outputs[i].unit) )
-                     {
-                        elog( "Insert Bid: ${bid}", ("bid",market_order(cbb.ask_price, output_reference( t.id(), i )) ) );
-                        _market_db.insert_bid( market_order(cbb.ask_price, output_reference( t.id(), i )) );
-                     }
-                     else
-                     {
-                        elog( "Insert Ask: ${bid}", ("bid",market_order(cbb.ask_price, output_reference( t.id(), i )) ) );
-                        _market_db.insert_ask( market_order(cbb.ask_price, output_reference( t.id(), i )) );
-                     }
-                  }
-                  else if( t.outputs[i].claim_func == claim_by_long )
+                  _unspent.insert( output_reference( trx_id, i ), unspent_output( t.outputs[i], tn ) );
+                  insert_market_orders( output_reference( trx_id, i ), t.outputs[i], &pend.undo );
+               }
+               if( _index_addresses )
+               {
+                  index_addresses( trx_id, tn, t, pend.address_index, true );
+               }
+            }
+
+            /** @return a filter over the owners of the outputs created and spent by block_num */
+            address_filter build_address_filter( uint32_t block_num, const pending_block& pend )
+            {
+               std::vector<address> owners;
+               for( auto trx = pend.meta_trxs.begin(); trx != pend.meta_trxs.end(); ++trx )
+               {
+                  if( trx->first.block_num != block_num ) continue; // a source loaded by mark_spent
+                  for( auto out = trx->second.outputs.begin(); out != trx->second.outputs.end(); ++out )
                   {
-                    auto cbl = t.outputs[i].as<claim_by_long_output>();
-                    elog( "Insert Short Ask: ${bid}", ("bid",market_order(cbl.ask_price, output_reference( t.id(), i )) ) );
-                    _market_db.insert_bid( market_order(cbl.ask_price, output_reference( t.id(), i )) );
+                     auto owner = output_owner( *out );
+                     if( owner ) owners.push_back( *owner );
                   }
                }
+               for( auto itr = pend.undo.spent.begin(); itr != pend.undo.spent.end(); ++itr )
+               {
+                  auto owner = output_owner( itr->output.output );
+                  if( owner ) owners.push_back( *owner );
+               }
+
+               address_filter filter( owners.size() );
+               for( auto itr = owners.begin(); itr != owners.end(); ++itr )
+               {
+                  filter.insert( *itr );
+               }
+               return filter;
             }
 
+            /**
+             *  Writes the block and all of its transactions with one batch per table.  
+             *
+             *  The undo record is written first and the block header last, both 
+             *  with a durable sync.  The head is only read back from the blocks 
+             *  table, so a crash in between leaves an undo record above the head 
+             *  which open() uses to roll back whatever part of the block was written.
+             *
+             *  The other tables are separate databases and are only synced every
+             *  BITSHARE_SYNC_INTERVAL blocks, a sync flushes every earlier write to
+             *  the same database.  An OS crash can lose their writes for the blocks
+             *  since, which replay_unsynced_blocks() restores from the undo records.
+             */
             void store( const trx_block& b )
             {
+                pending_block pend;
                 std::vector<uint160> trxs_ids;
+                trxs_ids.reserve( b.trxs.size() );
+
+                prefetch_sources( pend, b.trxs );
+
+                _market_db.start_batch();
+                _unspent.start_batch();
                 for( uint16_t t = 0; t < b.trxs.size(); ++t )
                 {
-                   store( b.trxs[t], trx_num( b.block_num, t) );
+                   store( pend, b.trxs[t], trx_num( b.block_num, t) );
                    trxs_ids.push_back( b.trxs[t].id() );
                 }
+
+                ldb::WriteBatch meta_trxs_batch;
+                for( auto itr = pend.meta_trxs.begin(); itr != pend.meta_trxs.end(); ++itr )
+                {
+                   meta_trxs.store( itr->first, itr->second, meta_trxs_batch );
+                }
+                ldb::WriteBatch trx_id2num_batch;
+                for( auto itr = pend.trx_id2num.begin(); itr != pend.trx_id2num.end(); ++itr )
+                {
+                   trx_id2num.store( itr->first, itr->second, trx_id2num_batch );
+                }
+                auto block_id = b.id();
+                pend.undo.block_id = block_id;
+                pend.undo.block    = b;
+                ldb::WriteBatch undo_batch;
+                undo_db.store( b.block_num, pend.undo, undo_batch );
+                if( b.block_num >= BITSHARE_MAX_UNDO_BLOCKS )
+                {
+                   undo_db.remove( b.block_num - BITSHARE_MAX_UNDO_BLOCKS, undo_batch );
+                }
+
+                ldb::WriteBatch block_trxs_batch;
+                block_trxs.store( b.block_num, trxs_ids, block_trxs_batch );
+                ldb::WriteBatch block_filters_batch;
+                block_filters.store( b.block_num, build_address_filter( b.block_num, pend ), block_filters_batch );
+                ldb::WriteBatch blk_id2num_batch;
+                blk_id2num.store( block_id, b.block_num, blk_id2num_batch );
+                ldb::WriteBatch blocks_batch;
+                blocks.store( b.block_num, b, blocks_batch );
+
+                bool sync = b.block_num % BITSHARE_SYNC_INTERVAL == 0;
+                undo_db.write( undo_batch, true );
+                _market_db.commit_batch( sync );
+                _unspent.commit_batch( sync );
+                meta_trxs.write( meta_trxs_batch, sync );
+                trx_id2num.write( trx_id2num_batch, sync );
+                if( _index_addresses )
+                {
+                   set_address_index_blocks( b.block_num + 1, pend.address_index );
+                   address_index.write( pend.address_index, sync );
+                }
+                block_trxs.write( block_trxs_batch, sync );
+                block_filters.write( block_filters_batch, sync );
+                blk_id2num.write( blk_id2num_batch, sync );
+                blocks.write( blocks_batch, true );
+
                 head_block    = b;
-                head_block_id = b.id();
+                head_block_id = block_id;
+            }
+
+            /**
+             *  Reverts every change recorded in undo for block_num except the
+             *  block header, which the caller removes first.  Each step either
+             *  removes a record or restores it to its value before the block, so 
+             *  the rollback can be repeated if it is interrupted, or applied to a
+             *  block whose writes were only partly kept.  Every write is synced so
+             *  that the caller can drop the undo record afterward.
+             */
+            void rollback( uint32_t block_num, const block_undo& undo )
+            { try {
+               _market_db.start_batch();
+               _unspent.start_batch();
+               ldb::WriteBatch meta_trxs_batch;
+               ldb::WriteBatch trx_id2num_batch;
+
+               for( auto itr = undo.new_bids.begin(); itr != undo.new_bids.end(); ++itr )
+               {
+                  _market_db.remove_bid( *itr );
+               }
+               for( auto itr = undo.new_asks.begin(); itr != undo.new_asks.end(); ++itr )
+               {
+                  _market_db.remove_ask( *itr );
+               }
+
+               if( _index_addresses )
+               {
+                  ldb::WriteBatch address_index_batch;
+                  for( uint16_t t = 0; t < undo.block.trxs.size(); ++t )
+                  {
+                     index_addresses( undo.trxs[t].id, trx_num( block_num, t ), undo.block.trxs[t], address_index_batch, false );
+                  }
+                  set_address_index_blocks( block_num, address_index_batch );
+                  address_index.write( address_index_batch, true );
+               }
+
+               for( uint16_t t = 0; t < undo.trxs.size(); ++t )
+               {
+                  for( uint16_t i = 0; i < undo.trxs[t].output_count; ++i )
+                  {
+                     _unspent.remove( output_reference( undo.trxs[t].id, i ) );
+                  }
+                  trx_id2num.remove( undo.trxs[t].id, trx_id2num_batch );
+                  meta_trxs.remove( trx_num( block_num, t ), meta_trxs_batch );
+               }
+
+               std::map<trx_num,meta_trx> sources;
+               for( auto itr = undo.spent.begin(); itr != undo.spent.end(); ++itr )
+               {
+                  _unspent.insert( itr->ref, itr->output );
+                  insert_market_orders( itr->ref, itr->output.output, nullptr );
+
+                  auto src = sources.find( itr->output.source );
+                  if( src == sources.end() )
+                  {
+                     // a source stored by a block whose writes were lost goes away with that block
+                     auto stored = meta_trxs.try_fetch( itr->output.source );
+                     if( !stored ) continue;
+                     src = sources.insert( std::make_pair( itr->output.source, *stored ) ).first;
+                  }
+                  FC_ASSERT( src->second.meta_outputs.size() > itr->ref.output_idx );
+                  src->second.meta_outputs[itr->ref.output_idx] = meta_trx_output();
+               }
+               for( auto itr = sources.begin(); itr != sources.end(); ++itr )
+               {
+                  meta_trxs.store( itr->first, itr->second, meta_trxs_batch );
+               }
+
+               ldb::WriteBatch block_trxs_batch;
+               block_trxs.remove( block_num, block_trxs_batch );
+               ldb::WriteBatch block_filters_batch;
+               block_filters.remove( block_num, block_filters_batch );
+               ldb::WriteBatch blk_id2num_batch;
+               blk_id2num.remove( undo.block_id, blk_id2num_batch );
+
+               _market_db.commit_batch( true );
+               _unspent.commit_batch( true );
+               meta_trxs.write( meta_trxs_batch, true );
+               trx_id2num.write( trx_id2num_batch, true );
+               block_trxs.write( block_trxs_batch, true );
+               block_filters.write( block_filters_batch, true );
+               blk_id2num.write( blk_id2num_batch, true );
+            } FC_RETHROW_EXCEPTIONS( warn, "error rolling back block ${n}", ("n",block_num) ) }
+
+            /**
+             *  Rolls back the blocks stored since the last block that synced every
+             *  table and stores them again from their undo records, so any of their
+             *  writes lost by an OS crash are made again.  A block without an undo
+             *  record was not written by store() and is already durable.  Both
+             *  steps can be repeated, so being interrupted here is harmless.
+             */
+            void replay_unsynced_blocks()
+            { try {
+               if( head_block.block_num == INVALID_BLOCK_NUM ) return;
+               uint32_t synced = head_block.block_num - head_block.block_num % BITSHARE_SYNC_INTERVAL;
+
+               std::vector<block_undo> replay;
+               for( uint32_t n = head_block.block_num; n > synced; --n )
+               {
+                  auto undo = undo_db.find( n );
+                  if( !undo.valid() ) break;
+                  replay.push_back( undo.value() );
+                  rollback( n, replay.back() );
+               }
+               for( auto itr = replay.rbegin(); itr != replay.rend(); ++itr )
+               {
+                  store( itr->block );
+               }
+            } FC_RETHROW_EXCEPTIONS( warn, "error replaying the blocks after the last sync" ) }
 
-                blocks.store( b.block_num, b );
-                block_trxs.store( b.block_num, trxs_ids );
+            /** @return worker thread i, creating the threads up to i on first use */
+            fc::thread& get_worker( size_t i )
+            {
+               while( _worker_threads.size() <= i )
+               {
+                  _worker_threads.push_back( std::unique_ptr<fc::thread>( new fc::thread( "blockchain_worker" ) ) );
+               }
+               return *_worker_threads[i];
             }
 
+            /**
+             *  Appends every block that is BITSHARE_MAX_UNDO_BLOCKS below the head, 
+             *  and so can no longer be popped, to the archive once at least
+             *  min_blocks of them are waiting, so each sync of the archive covers
+             *  several blocks.  Blocks that are not archived yet are read from leveldb.
+             */
+            void archive_buried_blocks( uint32_t min_blocks = BITSHARE_SYNC_INTERVAL )
+            { try {
+               // the archive starts at the first block, nodes without all of the history keep none
+               if( _prune_depth || *_pruned_blocks || head_block.block_num == INVALID_BLOCK_NUM ) return;
+               if( uint64_t(_archive.size()) + BITSHARE_MAX_UNDO_BLOCKS + min_blocks > uint64_t(head_block.block_num) + 1 ) return;
+
+               std::vector<trx_block> buried;
+               for( uint32_t block_num = _archive.size();
+                    uint64_t(block_num) + BITSHARE_MAX_UNDO_BLOCKS <= head_block.block_num; ++block_num )
+               {
+                  trx_block b = blocks.fetch( block_num );
+                  auto trxs = meta_trxs.lower_bound( trx_num( block_num, 0 ) );
+                  for( ; trxs.valid() && trxs.key().block_num == block_num; ++trxs )
+                  {
+                     b.trxs.push_back( trxs.value() );
+                  }
+                  buried.push_back( std::move( b ) );
+                  if( buried.size() == BITSHARE_SYNC_INTERVAL )
+                  {
+                     _archive.append( buried );
+                     buried.clear();
+                  }
+               }
+               _archive.append( buried );
+            } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+            /**
+             *  Deletes the transactions of block_num and the transactions it spends
+             *  from once all of their outputs are spent in block_num or before.  A
+             *  transaction whose last spend is in a later block is still needed to
+             *  pop that block, or to export the state before it, and is deleted
+             *  when that block is pruned, since it is one of its sources.
+             */
+            void prune_block( uint32_t block_num )
+            {
+               std::map<trx_num,meta_trx> candidates;
+               std::set<trx_num>          sources;
+               for( auto itr = meta_trxs.lower_bound( trx_num( block_num, 0 ) ); 
+                    itr.valid() && itr.key().block_num == block_num; ++itr )
+               {
+                  meta_trx mtrx = itr.value();
+                  for( auto in = mtrx.inputs.begin(); in != mtrx.inputs.end(); ++in )
+                  {
+                     auto source = trx_id2num.try_fetch( in->output_ref.trx_hash );
+                     if( source ) sources.insert( *source );
+                  }
+                  candidates[itr.key()] = mtrx;
+               }
+               for( auto itr = sources.begin(); itr != sources.end(); ++itr )
+               {
+                  if( candidates.find( *itr ) != candidates.end() ) continue;
+                  auto source = meta_trxs.try_fetch( *itr );
+                  if( source ) candidates[*itr] = std::move( *source );
+               }
+
+               ldb::WriteBatch meta_trxs_batch;
+               ldb::WriteBatch trx_id2num_batch;
+               for( auto itr = candidates.begin(); itr != candidates.end(); ++itr )
+               {
+                  const auto& outs = itr->second.meta_outputs;
+                  bool spent_below = true;
+                  for( auto out = outs.begin(); spent_below && out != outs.end(); ++out )
+                  {
+                     spent_below = out->is_spent() && out->trx_id.block_num <= block_num;
+                  }
+                  if( !spent_below ) continue;
+
+                  meta_trxs.remove( itr->first, meta_trxs_batch );
+                  trx_id2num.remove( itr->second.id(), trx_id2num_batch );
+               }
+               // synced before the block is counted as pruned, it is not pruned again
+               meta_trxs.write( meta_trxs_batch, true );
+               trx_id2num.write( trx_id2num_batch, true );
+            }
+
+            /** prunes every block that is _prune_depth below the head */
+            void prune_buried_blocks()
+            { try {
+               if( !_prune_depth || head_block.block_num == INVALID_BLOCK_NUM ) return;
+               while( uint64_t(*_pruned_blocks) + _prune_depth <= head_block.block_num )
+               {
+                  prune_block( *_pruned_blocks );
+                  *_pruned_blocks = *_pruned_blocks + 1;
+               }
+               if( *_pruned_blocks >= _compacted_blocks + BITSHARE_PRUNE_COMPACT_INTERVAL )
+               {
+                  meta_trxs.compact( trx_num( _compacted_blocks, 0 ), trx_num( *_pruned_blocks, 0 ) );
+                  _compacted_blocks = *_pruned_blocks;
+               }
+            } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+            /** sets the head to block_num, or to an empty chain if block_num is invalid */
+            void load_head( uint32_t block_num )
+            {
+               if( block_num == INVALID_BLOCK_NUM )
+               {
+                  head_block    = trx_block();
+                  head_block_id = block_id_type();
+                  return;
+               }
+               head_block    = blocks.fetch( block_num );
+               head_block_id = head_block.id();
+            }
+
+            /** writes the state in snap to this empty chain, the head block header last */
+            void load_snapshot( const chain_snapshot& snap )
+            { try {
+               ldb::WriteBatch      meta_trxs_batch;
+               ldb::WriteBatch      trx_id2num_batch;
+               std::vector<uint160> head_trx_ids;
+               for( auto itr = snap.trxs.begin(); itr != snap.trxs.end(); ++itr )
+               {
+                  auto trx_id = itr->trx.id();
+                  meta_trxs.store( itr->num, itr->trx, meta_trxs_batch );
+                  trx_id2num.store( trx_id, itr->num, trx_id2num_batch );
+                  if( itr->num.block_num == snap.head.block_num ) head_trx_ids.push_back( trx_id );
+               }
+               meta_trxs.write( meta_trxs_batch, true );
+               trx_id2num.write( trx_id2num_batch, true );
+               rebuild_unspent();
+               rebuild_market();
+
+               // only the head block has all of its trxs
+               *_pruned_blocks = snap.head.block_num;
+
+               ldb::WriteBatch block_trxs_batch;
+               block_trxs.store( snap.head.block_num, head_trx_ids, block_trxs_batch );
+               block_trxs.write( block_trxs_batch, true );
+               ldb::WriteBatch blk_id2num_batch;
+               blk_id2num.store( snap.head.id(), snap.head.block_num, blk_id2num_batch );
+               blk_id2num.write( blk_id2num_batch, true );
+               ldb::WriteBatch blocks_batch;
+               blocks.store( snap.head.block_num, snap.head, blocks_batch );
+               blocks.write( blocks_batch, true );
+               load_head( snap.head.block_num );
+            } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+            void clear_fork_journal()
+            {
+               ldb::WriteBatch batch;
+               for( auto itr = fork_journal.begin(); itr.valid(); ++itr )
+               {
+                  fork_journal.remove( itr.key(), batch );
+               }
+               fork_journal.write( batch, true );
+            }
+
+            /**
+             *  Databases created before the unspent output index existed have to
+             *  build it from the spent flags of every stored transaction.
+             */
+            void rebuild_unspent()
+            { try {
+               wlog( "rebuilding unspent output index" );
+               _unspent.start_batch();
+               for( auto itr = meta_trxs.begin(); itr.valid(); ++itr )
+               {
+                  auto tn   = itr.key();
+                  auto mtrx = itr.value();
+                  auto id   = mtrx.id();
+                  for( uint16_t i = 0; i < mtrx.outputs.size(); ++i )
+                  {
+                     if( !mtrx.meta_outputs[i].is_spent() )
+                     {
+                        _unspent.insert( output_reference( id, i ), unspent_output( mtrx.outputs[i], tn ) );
+                     }
+                  }
+               }
+               _unspent.commit_batch( true );
+            } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+            /**
+             *  Databases created before the market orders were stored with their
+             *  terms have to place every unspent order again.
+             */
+            void rebuild_market()
+            { try {
+               wlog( "rebuilding market order index" );
+               _market_db.start_batch();
+               for( auto itr = meta_trxs.begin(); itr.valid(); ++itr )
+               {
+                  auto mtrx = itr.value();
+                  auto id   = mtrx.id();
+                  for( uint16_t i = 0; i < mtrx.outputs.size(); ++i )
+                  {
+                     if( !mtrx.meta_outputs[i].is_spent() )
+                     {
+                        insert_market_orders( output_reference( id, i ), mtrx.outputs[i], nullptr );
+                     }
+                  }
+               }
+               _market_db.commit_batch( true );
+            } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
             /**
              *  Pushes a new transaction into matched that pairs all bids/asks for a single quote/base pair
              */
             void match_orders( std::vector<signed_transaction>& matched,  asset::type quote, asset::type base )
             { try {
                ilog( "match orders.." );
-               auto asks = _market_db.get_asks( quote, base );
-               auto bids = _market_db.get_bids( quote, base );
-               wlog( "asks: ${asks}", ("asks",asks) );
-               wlog( "bids: ${bids}", ("bids",bids) );
+               // walk the books in place so the cost follows the number of fills
+               const market_db::order_set& asks = _market_db.get_ask_book( quote, base );
+               const market_db::order_set& bids = _market_db.get_bid_book( quote, base );
+               if( asks.empty() || bids.empty() ) return;
 
                fc::optional<trx_output>             ask_change;    // stores a claim_by_bid or claim_by_long
                fc::optional<trx_output>             bid_change;    // stores a claim_by_bid
@@ -198,8 +934,8 @@ namespace bts { namespace blockchain {
                trx_output working_ask;
                trx_output working_bid;
 
-               if( ask_itr != asks.end() ) working_ask = get_output( ask_itr->location );
-               if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+               if( ask_itr != asks.end() ) working_ask = ask_itr->second.get_output();
+               if( bid_itr != bids.rend() ) working_bid = bid_itr->second.get_output();
 
                bool has_change = false;
 
@@ -210,11 +946,11 @@ namespace bts { namespace blockchain {
                   
                   /*
                   if( ask_change ) {  working_ask = *ask_change;                         }
-                  else             {  working_ask = get_output( ask_itr->location );  
+                  else             {  working_ask = ask_itr->second.get_output();  
                                       working_ask_tmp_amount = working_ask.get_amount();  }
 
                   if( bid_change ) {  working_bid = *bid_change;                      }
-                  else             {  working_bid = get_output( bid_itr->location );  }
+                  else             {  working_bid = bid_itr->second.get_output();  }
                   */
 
                   claim_by_bid_output ask_claim = working_ask.as<claim_by_bid_output>();
@@ -266,12 +1002,12 @@ namespace bts { namespace blockchain {
                          working_bid.amount = bidder_change.get_rounded_amount();
                         // bid_change       = working_bid;
 
-                         market_trx.inputs.push_back( ask_itr->location );
+                         market_trx.inputs.push_back( ask_itr->first.location );
                          if( pay_asker.amount > static_cast<uint64_t>(0ull) )
                             market_trx.outputs.push_back( trx_output( claim_by_signature_output( ask_claim.pay_address ), pay_asker) );
                          pay_asker = asset(static_cast<uint64_t>(0ull),pay_asker.unit);
                          ++ask_itr;
-                         if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                         if( ask_itr != asks.end() )  working_ask = ask_itr->second.get_output();
                      }
                      else // we have filled the bid (short sell) 
                      {
@@ -287,18 +1023,18 @@ namespace bts { namespace blockchain {
                         // working_ask_tmp_amount = asker_change;
                          ask_change             = working_ask;
 
-                         market_trx.inputs.push_back( bid_itr->location );
+                         market_trx.inputs.push_back( bid_itr->first.location );
                          market_trx.outputs.push_back( 
                                  trx_output( claim_by_cover_output( loan_amount, long_claim.pay_address ), collateral_amount) );
 
                          loan_amount       = asset(static_cast<uint64_t>(0ull),loan_amount.unit);
                          collateral_amount = asset();
                          ++bid_itr;
-                         if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                         if( bid_itr != bids.rend() ) working_bid = bid_itr->second.get_output();
 
                          if( working_ask.amount < 10 )
                          {
-                            market_trx.inputs.push_back( ask_itr->location );
+                            market_trx.inputs.push_back( ask_itr->first.location );
                             ilog( "ASK CLAIM ADDR ${A} amnt ${a}", ("A",ask_claim.pay_address)("a",pay_asker) );
                             if( pay_asker != asset(static_cast<uint64_t>(0ull),pay_asker.unit) )
                             {
@@ -306,7 +1042,7 @@ namespace bts { namespace blockchain {
                             }
                             pay_asker = asset(pay_asker.unit);
                             ++ask_itr;
-                            if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                            if( ask_itr != asks.end() )  working_ask = ask_itr->second.get_output();
                          }
                      }
                   }
@@ -345,7 +1081,7 @@ namespace bts { namespace blockchain {
                         working_bid.amount = bidder_change.get_rounded_amount();
                         bid_change = working_bid;
 
-                        market_trx.inputs.push_back( ask_itr->location );
+                        market_trx.inputs.push_back( ask_itr->first.location );
                         ilog( "ASK CLAIM ADDR ${A} amnt ${a}", ("A",ask_claim.pay_address)("a",pay_asker) );
                         ilog( "BID CHANGE ${C}", ("C", working_bid ) );
                         if( pay_asker > asset(static_cast<uint64_t>(0ull),pay_asker.unit) )
@@ -354,7 +1090,7 @@ namespace bts { namespace blockchain {
                         }
                         pay_asker = asset(pay_asker.unit);
                         ++ask_itr;
-                        if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                        if( ask_itr != asks.end() )  working_ask = ask_itr->second.get_output();
                      }
                      else // then we have filled the bid or we have filled BOTH
                      {
@@ -376,23 +1112,23 @@ namespace bts { namespace blockchain {
                            working_ask.amount = 0;
                         }
 
-                        market_trx.inputs.push_back( bid_itr->location );
+                        market_trx.inputs.push_back( bid_itr->first.location );
                         ilog( "BID CLAIM ADDR ${A} ${a}", ("A",bid_claim.pay_address)("a",pay_bidder) );
                         market_trx.outputs.push_back( trx_output( claim_by_signature_output( bid_claim.pay_address ), pay_bidder) );
                         pay_bidder = asset(static_cast<uint64_t>(0ull),pay_bidder.unit);
 
                         ++bid_itr;
-                        if( bid_itr != bids.rend() ) working_bid = get_output( bid_itr->location );
+                        if( bid_itr != bids.rend() ) working_bid = bid_itr->second.get_output();
 
                         if( working_ask.amount < 10 )
                         {
-                           market_trx.inputs.push_back( ask_itr->location );
+                           market_trx.inputs.push_back( ask_itr->first.location );
                            ilog( "ASK CLAIM ADDR ${A} amnt ${a}", ("A",ask_claim.pay_address)("a",pay_asker) );
                            if( pay_asker.amount > 0 )
                               market_trx.outputs.push_back( trx_output( claim_by_signature_output( ask_claim.pay_address ), pay_asker) );
                            pay_asker = asset(static_cast<uint64_t>(0ull),pay_asker.unit);
                            ++ask_itr;
-                           if( ask_itr != asks.end() )  working_ask = get_output( ask_itr->location );
+                           if( ask_itr != asks.end() )  working_ask = ask_itr->second.get_output();
                         }
                      }
                   }
@@ -407,7 +1143,7 @@ namespace bts { namespace blockchain {
                   FC_ASSERT( ask_itr != asks.end() );
                   if( pay_asker.amount > 0 )
                   {
-                     market_trx.inputs.push_back( ask_itr->location );
+                     market_trx.inputs.push_back( ask_itr->first.location );
                      market_trx.outputs.push_back( working_ask );
                      market_trx.outputs.push_back( trx_output( claim_by_signature_output( ask_payout_address ), pay_asker ) );
                   }
@@ -417,7 +1153,7 @@ namespace bts { namespace blockchain {
                   FC_ASSERT( bid_itr != bids.rend() );
                   if( collateral_amount.amount > 10 )
                   {
-                     market_trx.inputs.push_back( bid_itr->location );
+                     market_trx.inputs.push_back( bid_itr->first.location );
                      market_trx.outputs.push_back( working_bid );
                      market_trx.outputs.push_back( trx_output( claim_by_cover_output( loan_amount, bid_payout_address ), collateral_amount) );
                   }
@@ -425,7 +1161,7 @@ namespace bts { namespace blockchain {
                   {
                      if( pay_bidder.amount > 10 )
                      {
-                        market_trx.inputs.push_back( bid_itr->location );
+                        market_trx.inputs.push_back( bid_itr->first.location );
                         market_trx.outputs.push_back( working_bid );
                         market_trx.outputs.push_back( trx_output( claim_by_signature_output( bid_payout_address ), pay_bidder ) );
                      }
@@ -456,6 +1192,7 @@ namespace bts { namespace blockchain {
      void blockchain_db::open( const fc::path& dir, bool create )
      {
        try {
+         detail::recover_interrupted_import( dir );
          if( !fc::exists( dir ) )
          {
               if( !create )
@@ -465,24 +1202,212 @@ namespace bts { namespace blockchain {
               }
               fc::create_directories( dir );
          }
-         my->blk_id2num.open( dir / "blk_id2num", create );
-         my->trx_id2num.open( dir / "trx_id2num", create );
-         my->meta_trxs.open(  dir / "meta_trxs",  create );
+         my->blk_id2num.open( dir / "blk_id2num", create, db::point_lookup_profile );
+         my->trx_id2num.open( dir / "trx_id2num", create, db::point_lookup_profile );
+         my->meta_trxs.open(  dir / "meta_trxs",  create, db::write_heavy_profile );
          my->blocks.open(     dir / "blocks",     create );
-         my->block_trxs.open( dir / "block_trxs", create );
+         my->block_trxs.open( dir / "block_trxs", create, db::scan_profile );
+         my->undo_db.open(    dir / "undo",       create );
+         my->address_index.open( dir / "address_index", create, db::scan_profile );
+         my->block_filters.open( dir / "block_filters", create, db::scan_profile );
+         my->fork_journal.open( dir / "fork_journal", create );
+         my->trx_id2num.set_cache_size( BITSHARE_TRX_CACHE_SIZE );
+         my->meta_trxs.set_cache_size( BITSHARE_TRX_CACHE_SIZE );
+         my->blocks.set_cache_size( BITSHARE_BLOCK_HEADER_CACHE_SIZE );
          my->_market_db.open( dir / "market" );
+         my->_unspent.open(   dir / "unspent" );
+         my->_archive.open(   dir / "archive" );
+         my->_pruned_blocks.open( dir / "pruned_blocks", true );
+         my->_checkpoint_status.open( dir / "checkpoint_status", true );
+         my->_checkpoints.clear();
+         my->_dir         = dir;
 
-         
          // read the last block from the DB
          my->blocks.last( my->head_block.block_num, my->head_block );
+
+         // an undo record above the head belongs to a push or pop that did not finish
+         auto unfinished = my->undo_db.find( my->head_block.block_num + 1 );
+         if( unfinished.valid() )
+         {
+            wlog( "rolling back unfinished block ${n}", ("n",unfinished.key()) );
+            my->rollback( unfinished.key(), unfinished.value() );
+            my->undo_db.remove( unfinished.key() );
+         }
+
          if( my->head_block.block_num != uint32_t(-1) )
          {
             my->head_block_id = my->head_block.id();
+            if( my->_unspent.size() == 0 )
+            {
+               my->rebuild_unspent();
+            }
+            if( my->_market_db.needs_reindex() )
+            {
+               my->rebuild_market();
+            }
+            my->replay_unsynced_blocks();
+         }
+
+         // a fork switch was interrupted, go back to the chain it replaced
+         if( my->fork_journal.begin().valid() )
+         {
+            wlog( "restoring the chain replaced by an unfinished fork switch" );
+            restore_fork_journal();
          }
 
+         // the blocks accepted on trust were not all popped, they are fetched again from peers
+         if( my->_checkpoint_status->state == detail::checkpoints_revalidating )
+         {
+            wlog( "popping the blocks after ${v} that were accepted on trust", ("v",my->_checkpoint_status->verified) );
+            while( head_block_num() != my->_checkpoint_status->verified )
+            {
+               full_block b;
+               std::vector<signed_transaction> trxs;
+               pop_block( b, trxs );
+            }
+            my->_checkpoint_status->state = detail::checkpoints_untrusted;
+         }
+
+         // the archive may be ahead of a chain that was rebuilt and behind one
+         // that was stored before it existed
+         uint32_t buried = my->head_block.block_num == INVALID_BLOCK_NUM || 
+                           my->head_block.block_num < BITSHARE_MAX_UNDO_BLOCKS ? 0 :
+                           my->head_block.block_num - BITSHARE_MAX_UNDO_BLOCKS + 1;
+         my->_archive.truncate( buried );
+         my->archive_buried_blocks( 1 );
+
        } FC_RETHROW_EXCEPTIONS( warn, "error loading blockchain database ${dir}", ("dir",dir)("create",create) );
      }
 
+     void blockchain_db::enable_pruning( uint32_t depth )
+     { try {
+        FC_ASSERT( depth >= BITSHARE_MAX_UNDO_BLOCKS );
+        my->_prune_depth      = depth;
+        my->_compacted_blocks = *my->_pruned_blocks;
+        my->_archive.truncate( 0 );
+        my->prune_buried_blocks();
+     } FC_RETHROW_EXCEPTIONS( warn, "unable to enable pruning", ("depth",depth) ) }
+
+     void blockchain_db::export_snapshot( const fc::path& file, uint32_t block_num )
+     { try {
+        FC_ASSERT( head_block_num() != INVALID_BLOCK_NUM, "there is no chain to export" );
+        if( block_num == INVALID_BLOCK_NUM ) block_num = head_block_num();
+        FC_ASSERT( block_num <= head_block_num(), "block ${n} is not in the chain", ("n",block_num) );
+        FC_ASSERT( block_num >= *my->_pruned_blocks, "the state at block ${n} has been pruned", ("n",block_num) );
+
+        detail::chain_snapshot snap;
+        snap.head = fetch_block( block_num );
+        for( auto itr = my->meta_trxs.range( trx_num( 0, 0 ), trx_num( block_num + 1, 0 ) ); itr.valid(); ++itr )
+        {
+           meta_trx mtrx = itr.value();
+           bool     unspent = false;
+           for( auto out = mtrx.meta_outputs.begin(); out != mtrx.meta_outputs.end(); ++out )
+           {
+              // outputs spent after block_num were unspent as of block_num
+              if( out->is_spent() && out->trx_id.block_num > block_num ) *out = meta_trx_output();
+              unspent |= !out->is_spent();
+           }
+           if( unspent || itr.key().block_num == block_num )
+           {
+              snap.trxs.push_back( detail::snapshot_trx( itr.key(), mtrx ) );
+           }
+        }
+
+        auto packed   = fc::raw::pack( snap );
+        auto checksum = fc::sha256::hash( packed.data(), packed.size() );
+        std::ofstream out( file.generic_string().c_str(), std::ios::binary | std::ios::trunc );
+        out.write( packed.data(), packed.size() );
+        out.write( (const char*)&checksum, sizeof(checksum) );
+        out.close();
+        FC_ASSERT( out.good(), "unable to write snapshot" );
+        ilog( "exported ${n} transactions at block ${b}", ("n",snap.trxs.size())("b",snap.head.block_num) );
+     } FC_RETHROW_EXCEPTIONS( warn, "unable to export snapshot to ${file}", ("file",file)("block_num",block_num) ) }
+
+     void blockchain_db::import_snapshot( const fc::path& file )
+     { try {
+        FC_ASSERT( head_block_num() == INVALID_BLOCK_NUM, "snapshots can only be imported into an empty chain" );
+        auto snap = detail::read_snapshot( file );
+
+        // the trxs of the head block must hash to its trx_mroot and the head
+        // must match the checkpoint at its height
+        uint32_t   head_num = snap.head.block_num;
+        full_block head( snap.head );
+        FC_ASSERT( head_num != INVALID_BLOCK_NUM );
+        for( uint32_t i = 0; i < snap.trxs.size(); ++i )
+        {
+           const detail::snapshot_trx& st = snap.trxs[i];
+           FC_ASSERT( i == 0 || snap.trxs[i-1].num < st.num, "snapshot trxs are out of order" );
+           FC_ASSERT( st.num.block_num <= head_num, "snapshot trx is above the head block" );
+           FC_ASSERT( st.trx.meta_outputs.size() == st.trx.outputs.size() );
+           if( st.num.block_num == head_num )
+           {
+              FC_ASSERT( st.num.trx_idx == head.trx_ids.size(), "snapshot is missing trxs of the head block" );
+              head.trx_ids.push_back( st.trx.id() );
+           }
+        }
+        FC_ASSERT( head.calculate_merkle_root() == snap.head.trx_mroot, "snapshot trxs do not match the head block" );
+        auto checkpoint = my->_checkpoints.find( head_num );
+        FC_ASSERT( checkpoint == my->_checkpoints.end() || checkpoint->second == snap.head.id(),
+                   "snapshot head does not match the checkpoint at block ${n}", ("n",head_num) );
+
+        // the snapshot is loaded into a new chain that takes the place of this
+        // one once it is complete, so an interrupted import leaves either the
+        // empty chain or the imported one
+        fc::path dir     = my->_dir;
+        fc::path staging = detail::import_path( dir );
+        if( fc::exists( staging ) ) fc::remove_all( staging );
+        {
+           blockchain_db staged;
+           staged.open( staging );
+           staged.my->load_snapshot( snap );
+        }
+
+        auto     checkpoints     = my->_checkpoints;
+        bool     index_addresses = my->_index_addresses;
+        uint32_t prune_depth     = my->_prune_depth;
+        close();
+        fc::rename( dir, detail::replaced_path( dir ) );
+        fc::rename( staging, dir );
+        fc::remove_all( detail::replaced_path( dir ) );
+
+        open( dir );
+        my->_checkpoints = checkpoints;
+        if( index_addresses ) enable_address_index();
+        if( prune_depth )     enable_pruning( prune_depth );
+        ilog( "imported ${n} transactions at block ${b}", ("n",snap.trxs.size())("b",snap.head.block_num) );
+     } FC_RETHROW_EXCEPTIONS( warn, "unable to import snapshot from ${file}", ("file",file) ) }
+
+     void blockchain_db::add_checkpoint( uint32_t block_num, const block_id_type& id )
+     {
+        my->_checkpoints[block_num] = id;
+     }
+
+     void blockchain_db::enable_address_index()
+     { try {
+        my->_index_addresses = true;
+        uint32_t blocks = head_block_num() + 1; // 0 for an empty chain
+        if( my->address_index_blocks() == blocks ) return;
+
+        wlog( "rebuilding address index" );
+        std::vector<address_output_key> stale;
+        for( auto itr = my->address_index.begin(); itr.valid(); ++itr )
+        {
+           stale.push_back( itr.key() );
+        }
+        ldb::WriteBatch batch;
+        for( auto itr = stale.begin(); itr != stale.end(); ++itr )
+        {
+           my->address_index.remove( *itr, batch );
+        }
+        for( auto itr = my->meta_trxs.begin(); itr.valid(); ++itr )
+        {
+           auto mtrx = itr.value();
+           my->index_addresses( mtrx.id(), itr.key(), mtrx, batch, true );
+        }
+        my->address_index.store( address_output_key( address(), trx_num( blocks, 0 ), 0 ), output_reference(), batch );
+        my->address_index.write( batch, true );
+     } FC_RETHROW_EXCEPTIONS( warn, "unable to enable the address index" ) }
+
      void blockchain_db::close()
      {
         my->blk_id2num.close();
@@ -490,6 +1415,13 @@ namespace bts { namespace blockchain {
         my->blocks.close();
         my->block_trxs.close();
         my->meta_trxs.close();
+        my->undo_db.close();
+        my->address_index.close();
+        my->block_filters.close();
+        my->fork_journal.close();
+        my->_market_db.close();
+        my->_unspent.close();
+        my->_archive.close();
      }
 
     uint32_t blockchain_db::head_block_num()const
@@ -498,7 +1430,7 @@ namespace bts { namespace blockchain {
     }
     block_id_type blockchain_db::head_block_id()const
     {
-       return my->head_block.id();
+       return my->head_block_id;
     }
 
 
@@ -529,16 +1461,51 @@ namespace bts { namespace blockchain {
        return my->trx_id2num.fetch(trx_id);
     } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
 
+    fc::optional<trx_num> blockchain_db::try_fetch_trx_num( const uint160& trx_id )
+    { try {
+       return my->trx_id2num.try_fetch( trx_id );
+    } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
+
     meta_trx    blockchain_db::fetch_trx( const trx_num& trx_id )
     { try {
        return my->meta_trxs.fetch( trx_id );
     } FC_RETHROW_EXCEPTIONS( warn, "trx_id ${trx_id}", ("trx_id",trx_id) ) }
 
+    std::vector<output_reference> blockchain_db::fetch_address_history( const address& owner )
+    { try {
+       FC_ASSERT( my->_index_addresses, "the address index is not enabled" );
+       FC_ASSERT( owner != address(), "the null address is reserved by the index" );
+       std::vector<output_reference> history;
+       for( auto itr = my->address_index.lower_bound( address_output_key( owner, trx_num( 0, 0 ), 0 ) );
+            itr.valid() && itr.key().owner == owner; ++itr )
+       {
+          history.push_back( itr.value() );
+       }
+       return history;
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner) ) }
+
+    std::vector< std::pair<output_reference,unspent_output> > blockchain_db::fetch_address_unspent( const address& owner )
+    { try {
+       auto history = fetch_address_history( owner );
+       std::vector< std::pair<output_reference,unspent_output> > unspent;
+       for( auto itr = history.begin(); itr != history.end(); ++itr )
+       {
+          const unspent_output* out = my->_unspent.find( *itr );
+          if( out ) unspent.push_back( std::make_pair( *itr, *out ) );
+       }
+       return unspent;
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner) ) }
+
     uint32_t    blockchain_db::fetch_block_num( const block_id_type& block_id )
     { try {
        return my->blk_id2num.fetch( block_id ); 
     } FC_RETHROW_EXCEPTIONS( warn, "block id: ${block_id}", ("block_id",block_id) ) }
 
+    fc::optional<uint32_t> blockchain_db::try_fetch_block_num( const block_id_type& block_id )
+    { try {
+       return my->blk_id2num.try_fetch( block_id );
+    } FC_RETHROW_EXCEPTIONS( warn, "block id: ${block_id}", ("block_id",block_id) ) }
+
     block_header blockchain_db::fetch_block( uint32_t block_num )
     {
        return my->blocks.fetch(block_num);
@@ -553,18 +1520,69 @@ namespace bts { namespace blockchain {
 
     trx_block  blockchain_db::fetch_trx_block( uint32_t block_num )
     { try {
+       if( block_num < my->_archive.size() )
+       {
+          return my->_archive.fetch( block_num );
+       }
        trx_block fb = my->blocks.fetch(block_num);
-       auto trx_ids = my->block_trxs.fetch( block_num );
-       for( uint32_t i = 0; i < trx_ids.size(); ++i )
+       auto trxs = fetch_block_trxs( block_num );
+       fb.trxs.reserve( trxs.size() );
+       for( uint32_t i = 0; i < trxs.size(); ++i )
        {
-          auto trx_num = fetch_trx_num(trx_ids[i]);
-          fb.trxs.push_back( fetch_trx( trx_num ) );
+          fb.trxs.push_back( trxs[i] );
        }
-       // TODO: fetch each trx and add it to the trx block
-       //fb.trx_ids = my->block_trxs.fetch( block_num );
        return fb;
     } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
 
+    std::vector<meta_trx> blockchain_db::fetch_block_trxs( uint32_t block_num )
+    { try {
+       FC_ASSERT( block_num >= *my->_pruned_blocks, "block has been pruned", ("pruned_blocks",*my->_pruned_blocks) );
+       std::vector<meta_trx> trxs;
+       for( auto itr = my->meta_trxs.lower_bound( trx_num( block_num, 0 ) ); 
+            itr.valid() && itr.key().block_num == block_num; ++itr )
+       {
+          trxs.push_back( itr.value() );
+       }
+       return trxs;
+    } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
+
+    merkle_branch blockchain_db::fetch_trx_branch( const transaction_id_type& trx_id )
+    { try {
+       auto tn = fetch_trx_num( trx_id );
+       merkle_tree tree( my->block_trxs.fetch( tn.block_num ) );
+       return tree.get_branch( tn.trx_idx );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("trx_id",trx_id) ) }
+
+    fc::optional<address_filter> blockchain_db::fetch_address_filter( uint32_t block_num )
+    { try {
+       return my->block_filters.try_fetch( block_num );
+    } FC_RETHROW_EXCEPTIONS( warn, "block ${block}", ("block",block_num) ) }
+
+    std::vector<uint32_t> blockchain_db::match_address_filters( const std::vector<address>& addrs, uint32_t from_block_num,
+                                                                uint32_t to_block_num )
+    { try {
+       std::vector<uint32_t> matches;
+       uint32_t head = head_block_num();
+       if( head == INVALID_BLOCK_NUM ) return matches;
+       head = std::min( head, to_block_num );
+
+       // walk the filters in key order, blocks missing from the table have no filter
+       auto itr = my->block_filters.lower_bound( from_block_num );
+       for( uint32_t block_num = from_block_num; block_num <= head; ++block_num )
+       {
+          if( itr.valid() && itr.key() == block_num )
+          {
+             if( itr.value().may_contain_any( addrs ) ) matches.push_back( block_num );
+             ++itr;
+          }
+          else
+          {
+             matches.push_back( block_num );
+          }
+       }
+       return matches;
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("from_block_num",from_block_num)("to_block_num",to_block_num) ) }
+
     signed_transaction blockchain_db::fetch_transaction( const transaction_id_type& id )
     { try {
           auto trx_num = fetch_trx_num(id);
@@ -583,11 +1601,33 @@ namespace bts { namespace blockchain {
 
           std::vector<meta_trx_input> rtn;
           rtn.reserve( inputs.size() );
+
+          // spent outputs need their source trx, load each one once
+          std::unordered_map<uint160, std::pair<trx_num,meta_trx> > sources;
           for( uint32_t i = 0; i < inputs.size(); ++i )
           {
             try {
-             trx_num tn   = fetch_trx_num( inputs[i].output_ref.trx_hash );
-             meta_trx trx = fetch_trx( tn );
+             // the common case, an unspent output, does not need the source trx
+             const unspent_output* unspent = my->_unspent.find( inputs[i].output_ref );
+             if( unspent )
+             {
+                meta_trx_input metin;
+                metin.source       = unspent->source;
+                metin.output_num   = inputs[i].output_ref.output_idx;
+                metin.output       = unspent->output;
+                rtn.push_back( metin );
+                continue;
+             }
+
+             auto src = sources.find( inputs[i].output_ref.trx_hash );
+             if( src == sources.end() )
+             {
+                trx_num tn = fetch_trx_num( inputs[i].output_ref.trx_hash );
+                src = sources.insert( std::make_pair( inputs[i].output_ref.trx_hash, 
+                                                      std::make_pair( tn, fetch_trx( tn ) ) ) ).first;
+             }
+             const trx_num&  tn  = src->second.first;
+             const meta_trx& trx = src->second.second;
              
              if( inputs[i].output_ref.output_idx >= trx.meta_outputs.size() )
              {
@@ -614,6 +1654,18 @@ namespace bts { namespace blockchain {
     }
 
 
+    fc::optional<unspent_output> blockchain_db::fetch_unspent( const output_reference& ref )const
+    {
+       fc::optional<unspent_output> result;
+       const unspent_output* unspent = my->_unspent.find( ref );
+       if( unspent ) 
+       {
+          result = *unspent;
+       }
+       return result;
+    }
+
+
     /**
      *  Validates that trx could be included in a future block, that
      *  all inputs are unspent, that it is valid for the current time,
@@ -625,6 +1677,16 @@ namespace bts { namespace blockchain {
      *  @throw exception if trx can not be applied to the current chain state.
      */
     trx_eval blockchain_db::evaluate_signed_transaction( const signed_transaction& trx )       
+    {
+       return evaluate_signed_transaction( trx, get_signers( trx ) );
+    }
+
+    trx_eval blockchain_db::evaluate_signed_transaction( const signed_transaction& trx, const std::unordered_set<address>& signers )
+    {
+       return evaluate( trx, signers, false );
+    }
+
+    trx_eval blockchain_db::evaluate( const signed_transaction& trx, const std::unordered_set<address>& signers, bool trust_signatures )
     {
        try {
            FC_ASSERT( trx.inputs.size() || trx.outputs.size() );
@@ -639,7 +1701,8 @@ namespace bts { namespace blockchain {
            }
            */
 
-           trx_validation_state vstate( trx, this ); 
+           trx_validation_state vstate( trx, signers, this ); 
+           vstate.trust_signatures = trust_signatures;
            vstate.validate();
 
            trx_eval e;
@@ -668,16 +1731,104 @@ namespace bts { namespace blockchain {
     trx_eval blockchain_db::evaluate_signed_transactions( const std::vector<signed_transaction>& trxs )
     {
       try {
+        auto signers = recover_signers( trxs );
+
         trx_eval total_eval;
-        for( auto itr = trxs.begin(); itr != trxs.end(); ++itr )
+        for( uint32_t i = 0; i < trxs.size(); ++i )
         {
-            total_eval += evaluate_signed_transaction( *itr );
+            total_eval += evaluate_signed_transaction( trxs[i], signers[i] );
         }
         ilog( "summary: ${totals}", ("totals",total_eval) );
         return total_eval;
       } FC_RETHROW_EXCEPTIONS( debug, "" );
     }
 
+    /**
+     *  Evaluates trxs from a block below a trusted checkpoint without recovering
+     *  their signatures, except for trxs that spend a bid or long.  A trx that
+     *  fails is evaluated again in full.
+     */
+    trx_eval blockchain_db::evaluate_trusted_transactions( const std::vector<signed_transaction>& trxs )
+    {
+      try {
+        trx_eval total_eval;
+        for( uint32_t i = 0; i < trxs.size(); ++i )
+        {
+           try {
+              total_eval += evaluate( trxs[i], std::unordered_set<address>(), true );
+           } 
+           catch ( const fc::exception& e )
+           {
+              wlog( "trusted evaluation of trx ${i} failed, validating it fully\n${e}", ("i",i)("e",e.to_detail_string()) );
+              total_eval += evaluate_signed_transaction( trxs[i] );
+           }
+        }
+        return total_eval;
+      } FC_RETHROW_EXCEPTIONS( debug, "" );
+    }
+
+    std::vector< std::unordered_set<address> > blockchain_db::recover_signers( const std::vector<signed_transaction>& trxs )
+    { try {
+       std::vector< std::unordered_set<address> > signers( trxs.size() );
+
+       auto recover_range = [&]( size_t begin, size_t end )
+       {
+          for( size_t i = begin; i < end; ++i )
+          {
+             try { 
+                signers[i] = my->_sig_cache.get_signers( trxs[i] ); 
+             } 
+             catch ( const fc::exception& e )
+             {
+                wlog( "unable to recover signers of trx ${i}: ${e}", ("i",i)("e",e.to_detail_string()) );
+             }
+          }
+       };
+
+       size_t workers = std::min<size_t>( std::max( 1u, std::thread::hardware_concurrency() ), 
+                                          trxs.size() / BITSHARE_MIN_TRXS_PER_RECOVERY_THREAD );
+       if( workers <= 1 )
+       {
+          recover_range( 0, trxs.size() );
+          return signers;
+       }
+
+       // each worker fills a disjoint range of signers
+       std::vector< fc::future<void> > done;
+       done.reserve( workers );
+       size_t per_worker = (trxs.size() + workers - 1) / workers;
+       for( size_t w = 0; w < workers; ++w )
+       {
+          size_t begin = w * per_worker;
+          size_t end   = std::min( trxs.size(), begin + per_worker );
+          done.push_back( my->get_worker( w ).async( [=,&recover_range](){ recover_range( begin, end ); } ) );
+       }
+       for( auto itr = done.begin(); itr != done.end(); ++itr )
+       {
+          itr->wait();
+       }
+       return signers;
+    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+    std::unordered_set<address> blockchain_db::get_signers( const signed_transaction& trx )
+    {
+       return my->_sig_cache.get_signers( trx );
+    }
+
+    signature_cache::stats blockchain_db::get_signature_cache_stats()const
+    {
+       return my->_sig_cache.get_stats();
+    }
+
+    std::map<std::string,bts::db::cache_stats> blockchain_db::get_db_cache_stats()const
+    {
+       std::map<std::string,bts::db::cache_stats> stats;
+       stats["trx_id2num"] = my->trx_id2num.get_cache_stats();
+       stats["meta_trxs"]  = my->meta_trxs.get_cache_stats();
+       stats["blocks"]     = my->blocks.get_cache_stats();
+       return stats;
+    }
+
     void validate_unique_inputs( const std::vector<signed_transaction>& trxs )
     {
        std::unordered_set<output_reference> ref_outs;
@@ -709,25 +1860,214 @@ namespace bts { namespace blockchain {
         //validate_issuance( b, my->head_block /*aka new prev*/ );
         validate_unique_inputs( b.trxs );
 
+        auto checkpoint = my->_checkpoints.find( b.block_num );
+        if( checkpoint != my->_checkpoints.end() && checkpoint->second != b.id() )
+        {
+           elog( "block ${n} does not match checkpoint ${id}, validating all blocks fully", 
+                 ("n",b.block_num)("id",checkpoint->second) );
+           revalidate_trusted_blocks( b.block_num );
+           FC_THROW_EXCEPTION( exception, "block ${n} does not match checkpoint ${id}",
+                               ("n",b.block_num)("id",checkpoint->second) );
+        }
+        // only trust blocks that can still be popped when the checkpoint is reached
+        auto next_checkpoint = my->_checkpoints.lower_bound( b.block_num );
+        bool trusted = my->_checkpoint_status->state == detail::checkpoints_trusted &&
+                       next_checkpoint != my->_checkpoints.end() &&
+                       next_checkpoint->first - b.block_num < BITSHARE_MAX_UNDO_BLOCKS;
+
         // evaluate all trx and sum the results
-        trx_eval total_eval = evaluate_signed_transactions( b.trxs );
+        trx_eval total_eval = trusted ? evaluate_trusted_transactions( b.trxs ) 
+                                      : evaluate_signed_transactions( b.trxs );
         
         wlog( "total_fees: ${tf}", ("tf", total_eval.fees ) );
 
         my->store( b );
-        my->blk_id2num.store( b.id(), b.block_num );
-        
+
+        // open() and enable_pruning() catch up if these fail
+        try { 
+           my->archive_buried_blocks(); 
+           my->prune_buried_blocks(); 
+        } 
+        catch ( const fc::exception& e )
+        {
+           wlog( "unable to archive or prune buried blocks: ${e}", ("e",e.to_detail_string()) );
+        }
       } FC_RETHROW_EXCEPTIONS( warn, "unable to push block", ("b", b) );
     }
 
+    /**
+     *  Called when the block at mismatch_num does not match its checkpoint, so
+     *  the blocks after the last checkpoint the chain does match, and less than
+     *  BITSHARE_MAX_UNDO_BLOCKS below mismatch_num, were accepted on trust.
+     *  They are popped and pushed again with full validation, which leaves the
+     *  head at the last valid one.  open() finishes popping them if we are
+     *  interrupted.
+     */
+    void blockchain_db::revalidate_trusted_blocks( uint32_t mismatch_num )
+    { try {
+       uint32_t verified = INVALID_BLOCK_NUM;
+       for( auto itr = my->_checkpoints.begin(); itr != my->_checkpoints.end() && itr->first < mismatch_num; ++itr )
+       {
+          if( itr->first <= head_block_num() && fetch_block( itr->first ).id() == itr->second )
+          {
+             verified = itr->first;
+          }
+       }
+       // blocks further below the checkpoint were validated in full
+       if( mismatch_num >= BITSHARE_MAX_UNDO_BLOCKS &&
+           ( verified == INVALID_BLOCK_NUM || verified < mismatch_num - BITSHARE_MAX_UNDO_BLOCKS ) )
+       {
+          verified = mismatch_num - BITSHARE_MAX_UNDO_BLOCKS;
+       }
+       if( verified != INVALID_BLOCK_NUM && verified > head_block_num() ) verified = head_block_num();
+
+       my->_checkpoint_status->verified = verified;
+       my->_checkpoint_status->state    = detail::checkpoints_revalidating;
+
+       std::vector<trx_block> popped;
+       while( head_block_num() != verified )
+       {
+          full_block b;
+          std::vector<signed_transaction> trxs;
+          pop_block( b, trxs );
+          popped.push_back( trx_block( b, std::move(trxs) ) );
+       }
+       my->_checkpoint_status->state = detail::checkpoints_untrusted;
+
+       for( auto itr = popped.rbegin(); itr != popped.rend(); ++itr )
+       {
+          try {
+             push_block( *itr );
+          }
+          catch ( const fc::exception& e )
+          {
+             wlog( "block ${n} is invalid\n${e}", ("n",itr->block_num)("e",e.to_detail_string()) );
+             break;
+          }
+       }
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to revalidate the blocks before ${n}", ("n",mismatch_num) ) }
+
     /**
      *  Removes the top block from the stack and marks all spent outputs as 
      *  unspent.
      */
     void blockchain_db::pop_block( full_block& b, std::vector<signed_transaction>& trxs )
-    {
-       FC_ASSERT( !"TODO: implement pop_block" );
-    }
+    { try {
+       uint32_t block_num = head_block_num();
+       FC_ASSERT( block_num != INVALID_BLOCK_NUM, "there are no blocks to pop" );
+
+       auto undo = my->undo_db.find( block_num );
+       if( !undo.valid() )
+       {
+          FC_THROW_EXCEPTION( key_not_found_exception, 
+                "block ${n} is too old to be popped, only the last ${max} blocks may be undone", 
+                ("n",block_num)("max",BITSHARE_MAX_UNDO_BLOCKS) );
+       }
+
+       auto popped = fetch_trx_block( block_num );
+       
+       // once the header is gone open() will finish the rollback if we are interrupted,
+       // so it has to be durable before anything else is reverted
+       ldb::WriteBatch blocks_batch;
+       my->blocks.remove( block_num, blocks_batch );
+       my->blocks.write( blocks_batch, true );
+       my->rollback( block_num, undo.value() );
+       my->undo_db.remove( block_num );
+       my->load_head( block_num - 1 );
+
+       b = popped;
+       trxs.clear();
+       trxs.reserve( popped.trxs.size() );
+       for( auto itr = popped.trxs.begin(); itr != popped.trxs.end(); ++itr )
+       {
+          trxs.push_back( *itr );
+       }
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to pop block ${n}", ("n",head_block_num()) ) }
+
+    std::vector<trx_block> blockchain_db::switch_to_fork( const std::vector<trx_block>& fork )
+    { try {
+       FC_ASSERT( fork.size() > 0 );
+       uint32_t fork_num = fork.front().block_num;
+       FC_ASSERT( fork_num <= head_block_num() + 1 );
+
+       // everything that does not depend on the chain state is checked before
+       // any block is popped
+       if( fork_num > 0 )
+       {
+          FC_ASSERT( fork.front().prev == fetch_block( fork_num - 1 ).id(), "fork does not link to the chain" );
+       }
+       for( uint32_t i = 0; i < fork.size(); ++i )
+       {
+          FC_ASSERT( fork[i].block_num == fork_num + i );
+          FC_ASSERT( i == 0 || fork[i].prev == fork[i-1].id() );
+          FC_ASSERT( fork[i].trxs.size() > 0 );
+          FC_ASSERT( fork[i].trx_mroot == fork[i].calculate_merkle_root() );
+          validate_unique_inputs( fork[i].trxs );
+       }
+
+       // the replaced blocks are journaled before the first pop so that a
+       // failure at any point, including a crash, restores the exact prior head
+       std::vector<trx_block> popped;
+       ldb::WriteBatch        journal_batch;
+       for( uint32_t n = fork_num; n != head_block_num() + 1; ++n )
+       {
+          FC_ASSERT( my->undo_db.contains( n ),
+                     "block ${n} is too old to be popped, only the last ${max} blocks may be undone",
+                     ("n",n)("max",BITSHARE_MAX_UNDO_BLOCKS) );
+          popped.push_back( fetch_trx_block( n ) );
+          my->fork_journal.store( n, popped.back(), journal_batch );
+       }
+       my->fork_journal.write( journal_batch, true );
+
+       try {
+          while( head_block_num() + 1 > fork_num )
+          {
+             full_block                      b;
+             std::vector<signed_transaction> trxs;
+             pop_block( b, trxs );
+          }
+          for( uint32_t i = 0; i < fork.size(); ++i )
+          {
+             push_block( fork[i] );
+          }
+       }
+       catch ( const fc::exception& e )
+       {
+          wlog( "unable to switch to fork at ${n}, restoring the prior chain\n${e}",
+                ("n",fork_num)("e",e.to_detail_string()) );
+          restore_fork_journal();
+          throw;
+       }
+       my->clear_fork_journal();
+       return popped;
+    } FC_RETHROW_EXCEPTIONS( warn, "unable to switch to fork", ("fork_size",fork.size()) ) }
+
+    /**
+     *  Pops blocks until the head is on the chain recorded in the fork journal,
+     *  pushes the journaled blocks above it and then clears the journal.  If
+     *  this fails the journal is kept so that the next open() tries again.
+     */
+    void blockchain_db::restore_fork_journal()
+    { try {
+       auto first = my->fork_journal.begin();
+       if( !first.valid() ) return;
+       uint32_t fork_num = first.key();
+
+       while( head_block_num() != INVALID_BLOCK_NUM && head_block_num() >= fork_num )
+       {
+          auto prior = my->fork_journal.try_fetch( head_block_num() );
+          if( prior && prior->id() == head_block_id() ) break;
+
+          full_block                      b;
+          std::vector<signed_transaction> trxs;
+          pop_block( b, trxs );
+       }
+       for( auto itr = my->fork_journal.lower_bound( head_block_num() + 1 ); itr.valid(); ++itr )
+       {
+          push_block( itr.value() );
+       }
+       my->clear_fork_journal();
+    } FC_RETHROW_EXCEPTIONS( error, "unable to restore the chain replaced by a fork, it will be restored by open()" ) }
 
 
     uint64_t blockchain_db::current_bitshare_supply()
@@ -738,16 +2078,64 @@ namespace bts { namespace blockchain {
     /**
      *  Generates transactions that match all compatiable bids, asks, and shorts for
      *  all possible asset combinations and returns the result.
+     *
+     *  Only pairs whose book changed since they last matched nothing are matched, 
+     *  each pair on its own worker.  The trxs are returned ordered by base and
+     *  then quote unit no matter which worker finishes first.
      */
     std::vector<signed_transaction> blockchain_db::match_orders()
     { try {
+       auto pairs = my->_market_db.get_dirty_pairs();
+
+       std::vector< std::vector<signed_transaction> > pair_matched( pairs.size() );
+       std::vector< fc::exception_ptr >               pair_error( pairs.size() );
+       auto match_pair = [&]( size_t p )
+       {
+          try {
+             if( pairs[p].first > pairs[p].second )
+             {
+                my->match_orders( pair_matched[p], pairs[p].first, pairs[p].second );
+             }
+          } 
+          catch ( const fc::exception& e )
+          {
+             pair_error[p] = e.dynamic_copy_exception();
+          }
+       };
+
+       size_t workers = std::min<size_t>( std::max( 1u, std::thread::hardware_concurrency() ), pairs.size() );
+       if( workers <= 1 )
+       {
+          for( size_t p = 0; p < pairs.size(); ++p ) match_pair( p );
+       }
+       else
+       {
+          // worker w matches every pair p where p % workers == w 
+          std::vector< fc::future<void> > done;
+          done.reserve( workers );
+          for( size_t w = 0; w < workers; ++w )
+          {
+             done.push_back( my->get_worker( w ).async( [=,&match_pair]()
+             { 
+                for( size_t p = w; p < pairs.size(); p += workers ) match_pair( p );
+             } ) );
+          }
+          for( auto itr = done.begin(); itr != done.end(); ++itr )
+          {
+             itr->wait();
+          }
+       }
+
        std::vector<signed_transaction> matched;
-       for( uint32_t base = asset::bts; base < asset::count; ++base )
+       for( size_t p = 0; p < pairs.size(); ++p )
        {
-          for( uint32_t quote = base+1; quote < asset::count; ++quote )
+          if( pair_error[p] ) pair_error[p]->dynamic_rethrow_exception();
+          if( pair_matched[p].size() == 0 )
           {
-              my->match_orders( matched, asset::type(quote), asset::type(base) );
+             // nothing can match until an order is placed or removed
+             my->_market_db.mark_clean( pairs[p].first, pairs[p].second );
           }
+          matched.insert( matched.end(), pair_matched[p].begin(), pair_matched[p].end() );
        }
        return matched;
     } FC_RETHROW_EXCEPTIONS( warn, "" ) }
@@ -757,17 +2145,16 @@ namespace bts { namespace blockchain {
      *  sort them by fees and filter out transactions that are not valid.  Then
      *  filter out incompatible transactions (those that share the same inputs).
      */
-    trx_block  blockchain_db::generate_next_block( const std::vector<signed_transaction>& in_trxs )
+    trx_block  blockchain_db::generate_next_block( const std::vector<signed_transaction>& trxs )
     {
       try {
-         std::vector<signed_transaction> trxs = match_orders();
-         trxs.insert( trxs.end(), in_trxs.begin(), in_trxs.end() );
-
          std::vector<trx_stat>  stats;
          stats.reserve(trxs.size());
-         for( uint32_t i = 0; i < in_trxs.size(); ++i )
+
+         auto signers = recover_signers( trxs );
+         for( uint32_t i = 0; i < trxs.size(); ++i )
          {
-            ilog( "trx: ${t} signed by ${s}", ( "t",in_trxs[i])("s",in_trxs[i].get_signed_addresses() ) );
+            ilog( "trx: ${t} signed by ${s}", ( "t",trxs[i])("s",signers[i] ) );
          }
          
          // filter out all trx that generate coins from nothing or don't pay fees
@@ -776,7 +2163,7 @@ namespace bts { namespace blockchain {
             try 
             {
                 trx_stat s;
-                s.eval = evaluate_signed_transaction( trxs[i] );
+                s.eval = evaluate_signed_transaction( trxs[i], signers[i] );
 
                // TODO: enforce fees
                // if( s.eval.fees.amount == fc::uint128_t(0) )
@@ -796,50 +2183,78 @@ namespace bts { namespace blockchain {
 
          // order the trx by fees
          std::sort( stats.begin(), stats.end() ); 
+
+         std::vector<evaluated_trx> candidates;
+         candidates.reserve( stats.size() );
          for( uint32_t i = 0; i < stats.size(); ++i )
          {
            ilog( "sort ${i} => ${n}", ("i", i)("n",stats[i]) );
+           evaluated_trx etrx;
+           etrx.trx  = trxs[stats[i].trx_idx];
+           etrx.eval = stats[i].eval;
+           candidates.push_back( etrx );
          }
+         return generate_next_block( candidates );
 
+      } FC_RETHROW_EXCEPTIONS( warn, "error generating new block" );
+    }
+
+    trx_block  blockchain_db::generate_next_block( const std::vector<evaluated_trx>& trxs )
+    {
+      try {
+         // market trxs depend on the current order book so they are always evaluated
+         std::vector<signed_transaction> market_trxs = match_orders();
+         auto market_signers = recover_signers( market_trxs );
+
+         trx_block new_blk;
+         new_blk.trxs.reserve( market_trxs.size() + trxs.size() );
 
          // calculate the block size as we go
          fc::datastream<size_t>  block_size;
-         uint32_t conflicts = 0;
-
          asset total_fees;
-
          std::unordered_set<output_reference> consumed_outputs;
-         for( size_t i = 0; i < stats.size(); ++i )
+
+         auto try_include = [&]( const signed_transaction& trx, const trx_eval& eval ) -> bool
          {
-            const signed_transaction& trx = trxs[stats[i].trx_idx]; 
             for( size_t in = 0; in < trx.inputs.size(); ++in )
             {
-               ilog( "input ${in}", ("in", trx.inputs[in]) );
-
-               if( !consumed_outputs.insert( trx.inputs[in].output_ref ).second )
+               if( consumed_outputs.find( trx.inputs[in].output_ref ) != consumed_outputs.end() )
                {
-                    stats[i].trx_idx = uint16_t(-1); // mark it to be skipped, input conflict
-                    wlog( "INPUT CONFLICT!" );
-                    ++conflicts;
-                    break; //in = trx.inputs.size(); // exit inner loop
+                  wlog( "INPUT CONFLICT! ${in}", ("in", trx.inputs[in]) );
+                  return true;
                }
             }
-            if( stats[i].trx_idx != uint16_t(-1) )
+            fc::raw::pack( block_size, trx );
+            if( block_size.tellp() > MAX_BLOCK_TRXS_SIZE )
+            {
+               return false; // this trx put us over the top, we can stop processing
+            }
+            for( size_t in = 0; in < trx.inputs.size(); ++in )
             {
-               fc::raw::pack( block_size, trx );
-               if( block_size.tellp() > MAX_BLOCK_TRXS_SIZE )
-               {
-                  stats.resize(i); // this trx put us over the top, we can stop processing
-                                   // the other trxs.
-                  break;
-               }
-               FC_ASSERT( i < stats.size() );
-               ilog( "total fees ${tf} += ${fees}", 
-                     ("tf", total_fees)
-                     ("fees",stats[i].eval.fees) );
-               total_fees += stats[i].eval.fees;
+               consumed_outputs.insert( trx.inputs[in].output_ref );
             }
+            total_fees += eval.fees;
+            new_blk.trxs.push_back( trx );
+            return true;
+         };
+
+         bool has_room = true;
+         for( uint32_t i = 0; has_room && i < market_trxs.size(); ++i )
+         {
+            try 
+            {
+               has_room = try_include( market_trxs[i], evaluate_signed_transaction( market_trxs[i], market_signers[i] ) );
+            } 
+            catch ( const fc::exception& e )
+            {
+               wlog( "unable to use market trx ${t}\n ${e}", ("t", market_trxs[i] )("e",e.to_detail_string()) );
+            }
+         }
+         for( uint32_t i = 0; has_room && i < trxs.size(); ++i )
+         {
+            has_room = try_include( trxs[i].trx, trxs[i].eval );
          }
+         ilog( "total fees ${tf}", ("tf", total_fees) );
 
          // at this point we have a list of trxs to include in the block that is sorted by
          // fee and has a set of unique inputs that have all been validated against the
@@ -850,18 +2265,6 @@ namespace bts { namespace blockchain {
         // asset miner_fees( (total_fees.amount).high_bits(), asset::bts );
         // wlog( "miner fees: ${t}", ("t", miner_fees) );
 
-         trx_block new_blk;
-         new_blk.trxs.reserve( 1 + stats.size() - conflicts ); 
-
-         // add all other transactions to the block
-         for( size_t i = 0; i < stats.size(); ++i )
-         {
-           if( stats[i].trx_idx != uint16_t(-1) )
-           {
-             new_blk.trxs.push_back( trxs[ stats[i].trx_idx] );
-           }
-         }
-
          new_blk.timestamp                 = fc::time_point::now();
          new_blk.block_num                 = head_block_num() + 1;
          new_blk.prev                      = my->head_block_id;
@@ -878,31 +2281,27 @@ namespace bts { namespace blockchain {
     market_data blockchain_db::get_market( asset::type quote, asset::type base )
     {
        market_data d;
-       auto bids = my->_market_db.get_bids( quote, base );
+       const market_db::order_set& bids = my->_market_db.get_bid_book( quote, base );
        for( auto itr = bids.begin(); itr != bids.end(); ++itr )
        {
-           auto working_bid = my->get_output( itr->location );
+           const order_terms& working_bid = itr->second;
            if( working_bid.claim_func == claim_by_long )
            {
-              claim_by_long_output long_claim = working_bid.as<claim_by_long_output>();
-              d.shorts.push_back( short_data( long_claim.ask_price, working_bid.amount  ) );
-              d.bids.push_back( bid_data( long_claim.ask_price, 
-                                          (asset(working_bid.amount,asset::bts)*long_claim.ask_price ).get_rounded_amount()) );
+              d.shorts.push_back( short_data( working_bid.ask_price, working_bid.amount  ) );
+              d.bids.push_back( bid_data( working_bid.ask_price, 
+                                          (asset(working_bid.amount,asset::bts)*working_bid.ask_price ).get_rounded_amount()) );
               d.bids.back().is_short = true;
            }
            else
            {
-              claim_by_bid_output bid_claim = working_bid.as<claim_by_bid_output>();
-              d.bids.push_back( bid_data( bid_claim.ask_price, working_bid.amount ) );
+              d.bids.push_back( bid_data( working_bid.ask_price, working_bid.amount ) );
            }
        }
 
-       auto asks = my->_market_db.get_asks( quote, base );
+       const market_db::order_set& asks = my->_market_db.get_ask_book( quote, base );
        for( auto itr = asks.begin(); itr != asks.end(); ++itr )
        {
-           auto working_ask = my->get_output( itr->location );
-           claim_by_bid_output ask_claim = working_ask.as<claim_by_bid_output>();
-           d.asks.push_back( ask_data( ask_claim.ask_price, working_ask.amount ) );
+           d.asks.push_back( ask_data( itr->second.ask_price, itr->second.amount ) );
        }
        return d;
     }
@@ -912,19 +2311,19 @@ namespace bts { namespace blockchain {
       std::stringstream ss;
       ss << "Market "<< fc::variant(quote).as_string() <<" : "<<fc::variant(base).as_string() <<"<br/>\n";
       ss << "Bids<br/>\n";
-      auto bids = my->_market_db.get_bids( quote, base );
-      for( uint32_t b = 0; b < bids.size(); ++b )
+      const market_db::order_set& bids = my->_market_db.get_bid_book( quote, base );
+      uint32_t b = 0;
+      for( auto itr = bids.begin(); itr != bids.end(); ++itr, ++b )
       {
-        auto output = my->get_output( bids[b].location );
-        ss << b << "] " << fc::json::to_string( output ) <<" <br/>\n";
+        ss << b << "] " << fc::json::to_string( itr->second.get_output() ) <<" <br/>\n";
       }
 
       ss << "<br/>\nAsks<br/>\n";
-      auto asks = my->_market_db.get_asks( quote, base );
-      for( uint32_t a = 0; a < asks.size(); ++a )
+      const market_db::order_set& asks = my->_market_db.get_ask_book( quote, base );
+      uint32_t a = 0;
+      for( auto itr = asks.begin(); itr != asks.end(); ++itr, ++a )
       {
-        auto output = my->get_output( asks[a].location );
-        ss << a << "] " << fc::json::to_string( output ) <<" <br/>\n";
+        ss << a << "] " << fc::json::to_string( itr->second.get_output() ) <<" <br/>\n";
       }
       return ss.str();
     }
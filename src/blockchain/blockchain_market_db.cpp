@@ -4,15 +4,117 @@
 
 #include <fc/log/logger.hpp>
 
+#include <map>
+#include <set>
+
 namespace bts { namespace blockchain {
 
   namespace detail
   {
+     struct order_book
+     {
+        market_db::order_set bids;
+        market_db::order_set asks;
+     };
+
      class market_db_impl
      {
         public:
-           db::level_pod_map<market_order,uint32_t> _bids;
-           db::level_pod_map<market_order,uint32_t> _asks;
+           enum change_type
+           {
+              insert_bid,
+              insert_ask,
+              remove_bid,
+              remove_ask
+           };
+
+           struct change
+           {
+              change( change_type ty, const market_order& o, const order_terms& t = order_terms() )
+              :type(ty),order(o),terms(t){}
+
+              change_type  type;
+              market_order order;
+              order_terms  terms;
+           };
+
+           db::level_pod_map<market_order,order_terms> _bids;
+           db::level_pod_map<market_order,order_terms> _asks;
+
+           /** indexed by quote unit, base unit */
+           std::map< std::pair<int,int>, order_book > _books;
+           market_db::order_set                     _empty;
+           /** base unit, quote unit of every book changed since it was marked clean */
+           std::set< std::pair<int,int> >           _dirty;
+
+           bool                                     _batching;
+           bool                                     _needs_reindex;
+           leveldb::WriteBatch                      _bid_batch;
+           leveldb::WriteBatch                      _ask_batch;
+           /** changes applied to _books on commit */
+           std::vector<change>                      _pending;
+
+           market_db_impl():_batching(false),_needs_reindex(false){}
+
+           order_book& book_for( const market_order& m )
+           {
+              return _books[ std::make_pair( int(m.quote_unit.value), int(m.base_unit.value) ) ];
+           }
+
+           const order_book* find_book( asset::type quote, asset::type base )const
+           {
+              auto itr = _books.find( std::make_pair( int(quote), int(base) ) );
+              if( itr == _books.end() ) return nullptr;
+              return &itr->second;
+           }
+
+           void apply( const change& c )
+           {
+              order_book& book = book_for( c.order );
+              _dirty.insert( std::make_pair( int(c.order.base_unit.value), int(c.order.quote_unit.value) ) );
+              switch( c.type )
+              {
+                 case insert_bid: book.bids[c.order] = c.terms; break;
+                 case insert_ask: book.asks[c.order] = c.terms; break;
+                 case remove_bid: book.bids.erase( c.order );   break;
+                 case remove_ask: book.asks.erase( c.order );   break;
+              }
+           }
+
+           /**
+            *  Loads every order of table into the books.
+            *
+            *  @return false if table holds orders that were stored before the 
+            *          terms were kept with them.
+            */
+           bool load( db::level_pod_map<market_order,order_terms>& table, change_type c )
+           {
+              // read once at startup, not worth keeping in the block cache
+              for( auto itr = table.begin( db::scan_options() ); itr.valid(); ++itr )
+              {
+                 try {
+                    apply( change( c, itr.key(), itr.value() ) );
+                 } 
+                 catch ( const fc::exception& )
+                 {
+                    return false;
+                 }
+              }
+              return true;
+           }
+
+           void clear( db::level_pod_map<market_order,order_terms>& table )
+           {
+              std::vector<market_order> orders;
+              for( auto itr = table.begin(); itr.valid(); ++itr )
+              {
+                 orders.push_back( itr.key() );
+              }
+              for( auto itr = orders.begin(); itr != orders.end(); ++itr )
+              {
+                 table.remove( *itr );
+              }
+           }
      };
 
   } // namespace detail
@@ -25,6 +127,34 @@ namespace bts { namespace blockchain {
      return price( ratio, base_unit, quote_unit );
   }
 
+  order_terms::order_terms( const trx_output& out )
+  :amount(out.amount),unit(out.unit),claim_func(out.claim_func),min_trade(0)
+  {
+     if( out.claim_func == claim_by_bid )
+     {
+        auto cbb    = out.as<claim_by_bid_output>();
+        pay_address = cbb.pay_address;
+        ask_price   = cbb.ask_price;
+        min_trade   = cbb.min_trade;
+     }
+     else
+     {
+        auto cbl    = out.as<claim_by_long_output>();
+        pay_address = cbl.pay_address;
+        ask_price   = cbl.ask_price;
+        min_trade   = cbl.min_trade;
+     }
+  }
+
+  trx_output order_terms::get_output()const
+  {
+     if( claim_func == claim_by_long )
+     {
+        return trx_output( claim_by_long_output( pay_address, ask_price, min_trade ), amount, unit );
+     }
+     return trx_output( claim_by_bid_output( pay_address, ask_price, min_trade ), amount, unit );
+  }
+
 
   bool operator == ( const market_order& a, const market_order& b )
   {
@@ -58,89 +188,185 @@ namespace bts { namespace blockchain {
      fc::create_directories( db_dir / "bids" );
      fc::create_directories( db_dir / "asks" );
 
-     my->_bids.open( db_dir / "bids" );
-     my->_asks.open( db_dir / "asks" );
+     my->_bids.open( db_dir / "bids", true, db::scan_profile );
+     my->_asks.open( db_dir / "asks", true, db::scan_profile );
+
+     my->_books.clear();
+     my->_dirty.clear();
+     bool bids_loaded = my->load( my->_bids, detail::market_db_impl::insert_bid );
+     bool asks_loaded = my->load( my->_asks, detail::market_db_impl::insert_ask );
+     if( !bids_loaded || !asks_loaded )
+     {
+        wlog( "discarding market orders stored without their terms" );
+        my->clear( my->_bids );
+        my->clear( my->_asks );
+        my->_books.clear();
+        my->_dirty.clear();
+        my->_needs_reindex = true;
+     }
 
   } FC_RETHROW_EXCEPTIONS( warn, "unable to open market db ${dir}", ("dir",db_dir) ) }
 
-  void market_db::insert_bid( const market_order& m )
+  void market_db::close()
+  {
+     my->_bids.close();
+     my->_asks.close();
+     my->_books.clear();
+     my->_dirty.clear();
+  }
+
+  bool market_db::needs_reindex()const
+  {
+     return my->_needs_reindex;
+  }
+
+  void market_db::insert_bid( const market_order& m, const order_terms& t )
   {
-     my->_bids.store( m, 0 );
+     detail::market_db_impl::change c( detail::market_db_impl::insert_bid, m, t );
+     if( my->_batching )
+     {
+        my->_bids.store( m, t, my->_bid_batch );
+        my->_pending.push_back( c );
+     }
+     else
+     {
+        my->_bids.store( m, t );
+        my->apply( c );
+     }
   }
-  void market_db::insert_ask( const market_order& m )
+  void market_db::insert_ask( const market_order& m, const order_terms& t )
   {
-     my->_asks.store( m, 0 );
+     detail::market_db_impl::change c( detail::market_db_impl::insert_ask, m, t );
+     if( my->_batching )
+     {
+        my->_asks.store( m, t, my->_ask_batch );
+        my->_pending.push_back( c );
+     }
+     else
+     {
+        my->_asks.store( m, t );
+        my->apply( c );
+     }
   }
   void market_db::remove_bid( const market_order& m )
   {
-     my->_bids.remove(m);
+     if( my->_batching )
+     {
+        my->_bids.remove( m, my->_bid_batch );
+        my->_pending.push_back( detail::market_db_impl::change( detail::market_db_impl::remove_bid, m ) );
+     }
+     else
+     {
+        my->_bids.remove(m);
+        my->apply( detail::market_db_impl::change( detail::market_db_impl::remove_bid, m ) );
+     }
   }
   void market_db::remove_ask( const market_order& m )
   {
-     my->_asks.remove(m);
+     if( my->_batching )
+     {
+        my->_asks.remove( m, my->_ask_batch );
+        my->_pending.push_back( detail::market_db_impl::change( detail::market_db_impl::remove_ask, m ) );
+     }
+     else
+     {
+        my->_asks.remove(m);
+        my->apply( detail::market_db_impl::change( detail::market_db_impl::remove_ask, m ) );
+     }
   }
 
+  void market_db::start_batch()
+  {
+     // discard anything left behind by a batch that was never committed
+     my->_bid_batch.Clear();
+     my->_ask_batch.Clear();
+     my->_pending.clear();
+     my->_batching = true;
+  }
+
+  void market_db::commit_batch( bool sync )
+  { try {
+     FC_ASSERT( my->_batching );
+     my->_batching = false;
+     my->_bids.write( my->_bid_batch, sync );
+     my->_asks.write( my->_ask_batch, sync );
+
+     for( auto itr = my->_pending.begin(); itr != my->_pending.end(); ++itr )
+     {
+        my->apply( *itr );
+     }
+     my->_pending.clear();
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to commit market changes" ) }
+
   /** @pre quote > base  */
-  fc::optional<market_order> market_db::get_highest_bid( asset::type quote, asset::type base )
+  fc::optional<market_order> market_db::get_highest_bid( asset::type quote, asset::type base )const
   {
     FC_ASSERT( quote > base );
     fc::optional<market_order> highest_bid;
-
+    const order_set& bids = get_bid_book( quote, base );
+    if( !bids.empty() ) highest_bid = bids.rbegin()->first;
     return highest_bid;
   }
   /** @pre quote > base  */
-  fc::optional<market_order> market_db::get_lowest_ask( asset::type quote, asset::type base )
+  fc::optional<market_order> market_db::get_lowest_ask( asset::type quote, asset::type base )const
   {
     FC_ASSERT( quote > base );
     fc::optional<market_order> lowest_ask;
-
+    const order_set& asks = get_ask_book( quote, base );
+    if( !asks.empty() ) lowest_ask = asks.begin()->first;
     return lowest_ask;
   }
 
+  std::vector< std::pair<asset::type,asset::type> > market_db::get_dirty_pairs()const
+  {
+     std::vector< std::pair<asset::type,asset::type> > pairs;
+     pairs.reserve( my->_dirty.size() );
+     for( auto itr = my->_dirty.begin(); itr != my->_dirty.end(); ++itr )
+     {
+        pairs.push_back( std::make_pair( asset::type(itr->second), asset::type(itr->first) ) );
+     }
+     return pairs;
+  }
+
+  void market_db::mark_clean( asset::type quote, asset::type base )
+  {
+     my->_dirty.erase( std::make_pair( int(base), int(quote) ) );
+  }
+
+  const market_db::order_set& market_db::get_bid_book( asset::type quote_unit, asset::type base_unit )const
+  {
+     auto book = my->find_book( quote_unit, base_unit );
+     return book ? book->bids : my->_empty;
+  }
+
+  const market_db::order_set& market_db::get_ask_book( asset::type quote_unit, asset::type base_unit )const
+  {
+     auto book = my->find_book( quote_unit, base_unit );
+     return book ? book->asks : my->_empty;
+  }
+
   std::vector<market_order> market_db::get_bids( asset::type quote_unit, asset::type base_unit )const
   {
      FC_ASSERT( quote_unit > base_unit );
-
+     const order_set& bids = get_bid_book( quote_unit, base_unit );
      std::vector<market_order> orders;
-     market_order mo;
-     mo.base_unit  = base_unit;
-     mo.quote_unit = quote_unit;
-
-     auto order_itr  = my->_bids.lower_bound( mo );
-     while( order_itr.valid() )
-     {
-        auto order = order_itr.key();
-        if( order.quote_unit != quote_unit || order.base_unit != base_unit )
-        {
-            return orders;
-        }
-        orders.push_back(order);
-        ++order_itr;
-     }
-     ilog( "order_itr is not valid!" );
+     orders.reserve( bids.size() );
+     for( auto itr = bids.begin(); itr != bids.end(); ++itr )
+     {
+        orders.push_back( itr->first );
+     }
      return orders;
   }
   std::vector<market_order> market_db::get_asks( asset::type quote_unit, asset::type base_unit )const
   {
      FC_ASSERT( quote_unit > base_unit );
-
+     const order_set& asks = get_ask_book( quote_unit, base_unit );
      std::vector<market_order> orders;
-     market_order mo;
-     mo.base_unit  = base_unit;
-     mo.quote_unit = quote_unit;
-
-     auto order_itr  = my->_asks.lower_bound( mo );
-     while( order_itr.valid() )
-     {
-        auto order = order_itr.key();
-        if( order.quote_unit != quote_unit || order.base_unit != base_unit )
-        {
-            return orders;
-        }
-        orders.push_back(order);
-        ++order_itr;
-     }
-     ilog( "order_itr is not valid!" );
+     orders.reserve( asks.size() );
+     for( auto itr = asks.begin(); itr != asks.end(); ++itr )
+     {
+        orders.push_back( itr->first );
+     }
      return orders;
   }
 
@@ -0,0 +1,257 @@
+#include <bts/blockchain/blockchain_trx_pool.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/log/logger.hpp>
+
+#include <iterator>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace bts { namespace blockchain {
+
+  namespace detail
+  {
+     /** orders trxs by fee rate, highest first, ties broken by id */
+     struct fee_index
+     {
+        fee_index(){}
+        fee_index( const fc::uint128& r, const transaction_id_type& i )
+        :fee_rate(r),trx_id(i){}
+
+        fc::uint128          fee_rate;
+        transaction_id_type  trx_id;
+
+        friend bool operator < ( const fee_index& a, const fee_index& b )
+        {
+           if( a.fee_rate != b.fee_rate ) return a.fee_rate > b.fee_rate;
+           return a.trx_id < b.trx_id;
+        }
+     };
+
+     struct pending_trx
+     {
+        evaluated_trx       etrx;
+        fc::uint128         fee_rate;
+        size_t              size;
+     };
+
+     class trx_pool_impl
+     {
+        public:
+           trx_pool_impl( blockchain_db& c, uint32_t m )
+           :_chain(c),_max_size(m){}
+
+           blockchain_db&                                                 _chain;
+           uint32_t                                                       _max_size;
+
+           std::unordered_map<transaction_id_type,pending_trx>            _trxs;
+           std::set<fee_index>                                            _by_fee;
+           std::unordered_map<output_reference,transaction_id_type>       _by_input;
+           std::multimap<fc::time_point_sec,transaction_id_type>          _by_expiration;
+
+           void insert( const transaction_id_type& id, const pending_trx& p )
+           {
+              const signed_transaction& trx = p.etrx.trx;
+              _trxs[id] = p;
+              _by_fee.insert( fee_index( p.fee_rate, id ) );
+              for( auto itr = trx.inputs.begin(); itr != trx.inputs.end(); ++itr )
+              {
+                 _by_input[itr->output_ref] = id;
+              }
+              if( trx.valid_until != fc::time_point_sec() )
+              {
+                 _by_expiration.insert( std::make_pair( trx.valid_until, id ) );
+              }
+           }
+
+           void erase( const transaction_id_type& id )
+           {
+              auto itr = _trxs.find( id );
+              if( itr == _trxs.end() ) return;
+
+              const signed_transaction& trx = itr->second.etrx.trx;
+              _by_fee.erase( fee_index( itr->second.fee_rate, id ) );
+              for( auto in = trx.inputs.begin(); in != trx.inputs.end(); ++in )
+              {
+                 _by_input.erase( in->output_ref );
+              }
+              if( trx.valid_until != fc::time_point_sec() )
+              {
+                 auto range = _by_expiration.equal_range( trx.valid_until );
+                 for( auto exp = range.first; exp != range.second; ++exp )
+                 {
+                    if( exp->second == id ) { _by_expiration.erase( exp ); break; }
+                 }
+              }
+              _trxs.erase( itr );
+           }
+
+           /** removes the pending trx that spends ref, if any */
+           void erase_spender( const output_reference& ref )
+           {
+              auto itr = _by_input.find( ref );
+              if( itr != _by_input.end() )
+              {
+                 erase( transaction_id_type( itr->second ) );
+              }
+           }
+     };
+  } // namespace detail
+
+  trx_pool::trx_pool( blockchain_db& chain, uint32_t max_size )
+  :my( new detail::trx_pool_impl( chain, max_size ) )
+  {
+  }
+
+  trx_pool::~trx_pool()
+  {}
+
+  trx_eval trx_pool::add( const signed_transaction& trx )
+  { try {
+     auto trx_id = trx.id();
+     FC_ASSERT( my->_trxs.find( trx_id ) == my->_trxs.end(), "transaction is already pending" );
+
+     detail::pending_trx p;
+     p.etrx.trx  = trx;
+     p.etrx.eval = my->_chain.evaluate_signed_transaction( trx );
+     p.size      = fc::raw::pack_size( trx );
+     // scaled first so that trxs whose fees differ by less than one unit per byte still sort apart
+     p.fee_rate  = (p.etrx.eval.fees.amount * fc::uint128( BITSHARE_FEE_RATE_SCALE )) / fc::uint128( p.size );
+
+     std::set<transaction_id_type> conflicts;
+     for( auto itr = trx.inputs.begin(); itr != trx.inputs.end(); ++itr )
+     {
+        auto spender = my->_by_input.find( itr->output_ref );
+        if( spender == my->_by_input.end() ) continue;
+
+        const auto& other = my->_trxs[spender->second];
+        if( !(p.fee_rate > other.fee_rate) )
+        {
+           FC_THROW_EXCEPTION( exception, "input ${in} is spent by pending transaction ${other} which pays a higher fee rate",
+                               ("in",itr->output_ref)("other",spender->second) );
+        }
+        conflicts.insert( spender->second );
+     }
+
+     if( conflicts.empty() && my->_trxs.size() >= my->_max_size )
+     {
+        auto lowest = std::prev( my->_by_fee.end() );
+        FC_ASSERT( p.fee_rate > lowest->fee_rate, "transaction pool is full" );
+        conflicts.insert( lowest->trx_id );
+     }
+
+     for( auto itr = conflicts.begin(); itr != conflicts.end(); ++itr )
+     {
+        wlog( "replacing pending transaction ${id}", ("id",*itr) );
+        my->erase( *itr );
+     }
+     my->insert( trx_id, p );
+     return p.etrx.eval;
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to add transaction to the pool", ("trx",trx) ) }
+
+  void trx_pool::remove( const transaction_id_type& trx_id )
+  {
+     my->erase( trx_id );
+  }
+
+  bool trx_pool::contains( const transaction_id_type& trx_id )const
+  {
+     return my->_trxs.find( trx_id ) != my->_trxs.end();
+  }
+
+  size_t trx_pool::size()const
+  {
+     return my->_trxs.size();
+  }
+
+  void trx_pool::block_pushed( const trx_block& b )
+  {
+     for( auto trx = b.trxs.begin(); trx != b.trxs.end(); ++trx )
+     {
+        my->erase( trx->id() );
+        for( auto in = trx->inputs.begin(); in != trx->inputs.end(); ++in )
+        {
+           my->erase_spender( in->output_ref );
+        }
+     }
+  }
+
+  void trx_pool::block_popped( const std::vector<signed_transaction>& trxs )
+  {
+     for( auto trx = trxs.begin(); trx != trxs.end(); ++trx )
+     {
+        auto trx_id = trx->id();
+        for( uint16_t i = 0; i < trx->outputs.size(); ++i )
+        {
+           my->erase_spender( output_reference( trx_id, i ) );
+        }
+     }
+     for( auto trx = trxs.begin(); trx != trxs.end(); ++trx )
+     {
+        try {
+           add( *trx );
+        }
+        catch ( const fc::exception& e )
+        {
+           wlog( "dropping transaction from popped block ${id}\n${e}", ("id",trx->id())("e",e.to_detail_string()) );
+        }
+     }
+  }
+
+  void trx_pool::remove_expired( const fc::time_point_sec& now )
+  {
+     while( my->_by_expiration.size() && my->_by_expiration.begin()->first < now )
+     {
+        auto trx_id = my->_by_expiration.begin()->second;
+        wlog( "expiring pending transaction ${id}", ("id",trx_id) );
+        my->erase( trx_id );
+     }
+  }
+
+  std::vector<evaluated_trx> trx_pool::select( size_t max_bytes )
+  {
+     std::vector<evaluated_trx>       selected;
+     std::vector<transaction_id_type> stale;
+     size_t total = 0;
+     for( auto itr = my->_by_fee.begin(); itr != my->_by_fee.end(); ++itr )
+     {
+        const detail::pending_trx& p = my->_trxs.find( itr->trx_id )->second;
+
+        // the evaluation is only valid while every input is still unspent
+        bool unspent = true;
+        for( auto in = p.etrx.trx.inputs.begin(); unspent && in != p.etrx.trx.inputs.end(); ++in )
+        {
+           unspent = my->_chain.fetch_unspent( in->output_ref ).valid();
+        }
+        if( !unspent )
+        {
+           stale.push_back( itr->trx_id );
+           continue;
+        }
+
+        if( total + p.size > max_bytes ) break;
+        total += p.size;
+        selected.push_back( p.etrx );
+     }
+
+     for( auto itr = stale.begin(); itr != stale.end(); ++itr )
+     {
+        wlog( "dropping pending transaction ${id} which spends an output that is no longer unspent", ("id",*itr) );
+        my->erase( *itr );
+     }
+     return selected;
+  }
+
+  std::vector<signed_transaction> trx_pool::get_pending()const
+  {
+     std::vector<signed_transaction> pending;
+     pending.reserve( my->_by_fee.size() );
+     for( auto itr = my->_by_fee.begin(); itr != my->_by_fee.end(); ++itr )
+     {
+        pending.push_back( my->_trxs.find( itr->trx_id )->second.etrx.trx );
+     }
+     return pending;
+  }
+
+} } // bts::blockchain
@@ -0,0 +1,123 @@
+#include <bts/blockchain/blockchain_unspent_db.hpp>
+#include <bts/db/level_map.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <unordered_map>
+
+namespace bts { namespace blockchain {
+
+  namespace detail
+  {
+     class unspent_db_impl
+     {
+        public:
+           unspent_db_impl():_batching(false){}
+
+           db::level_map<output_reference,unspent_output>             _unspent_db;
+           std::unordered_map<output_reference,unspent_output>        _unspent;
+
+           bool                                                       _batching;
+           leveldb::WriteBatch                                        _batch;
+           /** changes applied to _unspent on commit, an invalid source marks a removal */
+           std::vector<std::pair<output_reference,unspent_output> >   _pending;
+     };
+
+  } // namespace detail
+
+  unspent_db::unspent_db()
+  :my( new detail::unspent_db_impl() )
+  {
+  }
+
+  unspent_db::~unspent_db()
+  {}
+
+  void unspent_db::open( const fc::path& db_dir )
+  { try {
+     my->_unspent_db.open( db_dir, true, db::point_lookup_profile );
+
+     my->_unspent.clear();
+     for( auto itr = my->_unspent_db.begin(); itr.valid(); ++itr )
+     {
+        my->_unspent[itr.key()] = itr.value();
+     }
+     ilog( "loaded ${n} unspent outputs", ("n", my->_unspent.size()) );
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to open unspent db ${dir}", ("dir",db_dir) ) }
+
+  void unspent_db::close()
+  {
+     my->_unspent_db.close();
+     my->_unspent.clear();
+  }
+
+  const unspent_output* unspent_db::find( const output_reference& ref )const
+  {
+     auto itr = my->_unspent.find( ref );
+     if( itr == my->_unspent.end() ) return nullptr;
+     return &itr->second;
+  }
+
+  size_t unspent_db::size()const
+  {
+     return my->_unspent.size();
+  }
+
+  void unspent_db::insert( const output_reference& ref, const unspent_output& out )
+  {
+     if( my->_batching )
+     {
+        my->_unspent_db.store( ref, out, my->_batch );
+        my->_pending.push_back( std::make_pair( ref, out ) );
+     }
+     else
+     {
+        my->_unspent_db.store( ref, out );
+        my->_unspent[ref] = out;
+     }
+  }
+
+  void unspent_db::remove( const output_reference& ref )
+  {
+     if( my->_batching )
+     {
+        my->_unspent_db.remove( ref, my->_batch );
+        my->_pending.push_back( std::make_pair( ref, unspent_output() ) );
+     }
+     else
+     {
+        my->_unspent_db.remove( ref );
+        my->_unspent.erase( ref );
+     }
+  }
+
+  void unspent_db::start_batch()
+  {
+     // discard anything left behind by a batch that was never committed
+     my->_batch.Clear();
+     my->_pending.clear();
+     my->_batching = true;
+  }
+
+  void unspent_db::commit_batch( bool sync )
+  { try {
+     FC_ASSERT( my->_batching );
+     my->_batching = false;
+     my->_unspent_db.write( my->_batch, sync );
+
+     for( auto itr = my->_pending.begin(); itr != my->_pending.end(); ++itr )
+     {
+        if( itr->second.source.block_num == trx_num::invalid_block_id )
+        {
+           my->_unspent.erase( itr->first );
+        }
+        else
+        {
+           my->_unspent[itr->first] = itr->second;
+        }
+     }
+     my->_pending.clear();
+  } FC_RETHROW_EXCEPTIONS( warn, "unable to commit unspent output changes" ) }
+
+} } // bts::blockchain
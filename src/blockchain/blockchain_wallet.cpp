@@ -176,6 +176,7 @@ namespace bts { namespace blockchain {
               {
                    trx.stake = _stake;
                    trx.timestamp = fc::time_point::now();
+                   trx.reset_id();
                    for( auto itr = addresses.begin(); itr != addresses.end(); ++itr )
                    {
                       self->sign_transaction( trx, *itr );
@@ -670,17 +671,25 @@ namespace bts { namespace blockchain {
    bool wallet::scan_chain( blockchain_db& chain, uint32_t from_block_num )
    { try {
        bool found = false;
-       auto head_block_num = chain.head_block_num();
-       // for each block
-       for( uint32_t i = from_block_num; i <= head_block_num; ++i )
+       std::vector<address> addrs;
+       addrs.reserve( my->_my_addresses.size() );
+       for( auto itr = my->_my_addresses.begin(); itr != my->_my_addresses.end(); ++itr )
        {
+          addrs.push_back( itr->first );
+       }
+
+       // only blocks whose address filter may reference one of our addresses are loaded
+       auto blocks = chain.match_address_filters( addrs, from_block_num );
+       for( auto blk = blocks.begin(); blk != blocks.end(); ++blk )
+       {
+          uint32_t i = *blk;
           ilog( "block: ${i}", ("i",i ) );
-          auto blk = chain.fetch_full_block( i );
+          auto trxs = chain.fetch_block_trxs( i );
           // for each transaction
-          for( uint32_t trx_idx = 0; trx_idx < blk.trx_ids.size(); ++trx_idx )
+          for( uint32_t trx_idx = 0; trx_idx < trxs.size(); ++trx_idx )
           {
               ilog( "trx: ${trx_idx}", ("trx_idx",trx_idx ) );
-              auto trx = chain.fetch_trx( trx_num( i, trx_idx ) ); //blk.trx_ids[trx_idx] );
+              const meta_trx& trx = trxs[trx_idx];
               ilog( "${id} \n\n  ${trx}\n\n", ("id",trx.id())("trx",trx) );
 
               for( uint32_t in_idx = 0; in_idx < trx.inputs.size(); ++in_idx )
@@ -0,0 +1,88 @@
+#include <bts/blockchain/signature_cache.hpp>
+#include <fc/thread/mutex.hpp>
+#include <fc/thread/scoped_lock.hpp>
+
+#include <list>
+#include <unordered_map>
+
+namespace bts { namespace blockchain {
+
+  namespace detail
+  {
+     class signature_cache_impl
+     {
+        public:
+           typedef std::list< std::pair<transaction_id_type, std::unordered_set<address> > > lru_list;
+
+           uint32_t                                                    _capacity;
+           lru_list                                                    _lru; // most recently used first
+           std::unordered_map<transaction_id_type, lru_list::iterator> _index;
+           signature_cache::stats                                      _stats;
+           mutable fc::mutex                                           _lock;
+
+           void evict_to( uint32_t size )
+           {
+              while( _lru.size() > size )
+              {
+                 _index.erase( _lru.back().first );
+                 _lru.pop_back();
+                 ++_stats.evictions;
+              }
+           }
+     };
+  }
+
+  signature_cache::signature_cache( uint32_t capacity )
+  :my( new detail::signature_cache_impl() )
+  {
+     my->_capacity = capacity;
+  }
+
+  signature_cache::~signature_cache()
+  {}
+
+  std::unordered_set<address> signature_cache::get_signers( const signed_transaction& trx )
+  {
+     auto trx_id = trx.id();
+     { 
+        fc::scoped_lock<fc::mutex> lock( my->_lock );
+        auto itr = my->_index.find( trx_id );
+        if( itr != my->_index.end() )
+        {
+           ++my->_stats.hits;
+           my->_lru.splice( my->_lru.begin(), my->_lru, itr->second );
+           return itr->second->second;
+        }
+        ++my->_stats.misses;
+     }
+
+     // recover without holding the lock so other threads are not serialized behind it
+     auto signers = trx.get_signed_addresses();
+
+     fc::scoped_lock<fc::mutex> lock( my->_lock );
+     if( my->_capacity > 0 && my->_index.find( trx_id ) == my->_index.end() )
+     {
+        my->_lru.push_front( std::make_pair( trx_id, signers ) );
+        my->_index[trx_id] = my->_lru.begin();
+        my->evict_to( my->_capacity );
+     }
+     return signers;
+  }
+
+  void signature_cache::set_capacity( uint32_t capacity )
+  {
+     fc::scoped_lock<fc::mutex> lock( my->_lock );
+     my->_capacity = capacity;
+     my->evict_to( capacity );
+  }
+
+  signature_cache::stats signature_cache::get_stats()const
+  {
+     fc::scoped_lock<fc::mutex> lock( my->_lock );
+     stats s    = my->_stats;
+     s.size     = my->_lru.size();
+     s.capacity = my->_capacity;
+     return s;
+  }
+
+} } // bts::blockchain
@@ -26,15 +26,23 @@ namespace bts { namespace blockchain {
 
    uint160                                 signed_transaction::id()const
    {
-      fc::sha512::encoder enc;
-      fc::raw::pack( enc, *this );
-      return small_hash( enc.result() );
+      return _id.get( [this]() -> uint160 {
+         fc::sha512::encoder enc;
+         fc::raw::pack( enc, *this );
+         return small_hash( enc.result() );
+      } );
+   }
+
+   void                                    signed_transaction::reset_id()
+   {
+      _id.reset();
    }
 
    void                                    signed_transaction::sign( const fc::ecc::private_key& k )
    {
     try {
       sigs.insert( k.sign_compact( digest() ) );  
+      _id.reset();
      } FC_RETHROW_EXCEPTIONS( warn, "error signing transaction", ("trx", *this ) );
    }
 
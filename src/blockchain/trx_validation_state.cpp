@@ -9,12 +9,25 @@
 namespace bts  { namespace blockchain { 
 
 trx_validation_state::trx_validation_state( const signed_transaction& t, blockchain_db* d, bool enf, uint32_t h )
-:trx(t),balance_sheet( asset::count ),db(d),enforce_unspent(enf),ref_head(h)
+:trx(t),balance_sheet( asset::count ),db(d),enforce_unspent(enf),ref_head(h),trust_signatures(false)
 { 
-  inputs  = d->fetch_inputs( t.inputs, ref_head );
+  init_balance_sheet();
+  signed_addresses = d->get_signers( t );
+}
+
+trx_validation_state::trx_validation_state( const signed_transaction& t, const std::unordered_set<address>& signers,
+                                            blockchain_db* d, bool enf, uint32_t h )
+:trx(t),balance_sheet( asset::count ),signed_addresses(signers),db(d),enforce_unspent(enf),ref_head(h),trust_signatures(false)
+{ 
+  init_balance_sheet();
+}
+
+void trx_validation_state::init_balance_sheet()
+{
+  inputs  = db->fetch_inputs( trx.inputs, ref_head );
   if( ref_head == std::numeric_limits<uint32_t>::max()  )
   {
-    ref_head = d->head_block_num();
+    ref_head = db->head_block_num();
   }
 
   for( auto i = 0; i < asset::count; ++i )
@@ -27,7 +40,6 @@ trx_validation_state::trx_validation_state( const signed_transaction& t, blockch
     balance_sheet[i].collat_out.unit  = (asset::bts);
     balance_sheet[i].neg_out.unit     = (asset::type)i;
   }
-  signed_addresses = t.get_signed_addresses();
 }
 
 void trx_validation_state::validate()
@@ -49,6 +61,9 @@ void trx_validation_state::validate()
        }
      }
      
+     // bid and long inputs depend on who signed, so the signers are needed before any input
+     if( !trust_signatures ) load_signers();
+
      for( uint32_t i = 0; i < inputs.size(); ++i )
      {
        try {
@@ -73,14 +88,15 @@ void trx_validation_state::validate()
         }
      }
 
-     if( !signed_addresses.size() )
-     {
-        signed_addresses =  trx.get_signed_addresses();
-     }
      std::vector<address> missing;
      for( auto itr  = required_sigs.begin(); itr != required_sigs.end(); ++itr )
      {
-        if( signed_addresses.find( *itr ) == signed_addresses.end() )
+        // below a trusted checkpoint the signers are only recovered when a claim depends on them
+        if( trust_signatures && !signed_addresses.size() )
+        {
+           if( !trx.sigs.size() ) missing.push_back( *itr );
+        }
+        else if( !is_signed_by( *itr ) )
         {
            missing.push_back( *itr );
         }
@@ -283,17 +299,42 @@ void trx_validation_state::validate_signature( const meta_trx_input& in )
  *       - left-over-bid sent to new output with same terms.
  *       - accepted and change bids > min amount
  */
+bool trx_validation_state::is_signed_by( const address& a )const
+{
+   return signed_addresses.find( a ) != signed_addresses.end();
+}
+
+/**
+ *  Recovers the signers when none were handed in, such as when a block was
+ *  checked in parallel and its recovery found no signatures.  Whether a bid or
+ *  long is canceled or accepted depends on who signed the trx, so its signers
+ *  are recovered even when signatures are trusted.
+ */
+void trx_validation_state::load_signers()
+{
+   if( signed_addresses.size() ) return;
+   if( trust_signatures )
+   {
+      signed_addresses = db->get_signers( trx );
+   }
+   else
+   {
+      signed_addresses = trx.get_signed_addresses();
+   }
+}
+
 void trx_validation_state::validate_bid( const meta_trx_input& in )
 { try {
     auto cbb = in.output.as<claim_by_bid_output>();
    
     asset output_bal( in.output.amount, in.output.unit );
     balance_sheet[(asset::type)in.output.unit].in += output_bal;
+    load_signers();
 
     wlog( "      *** SIGNED BY ***     \n ${signed} \n ", ("signed", signed_addresses) );
 
     // if the pay address has signed the trx, then that means this is a cancel request
-    if( signed_addresses.find( cbb.pay_address ) != signed_addresses.end() )
+    if( is_signed_by( cbb.pay_address ) )
     {
        //balance_sheet[asset::bts].in += output_bal; 
 
@@ -351,8 +392,9 @@ void trx_validation_state::validate_long( const meta_trx_input& in )
     auto long_claim = in.output.as<claim_by_long_output>();
     asset output_bal( in.output.amount, in.output.unit );
     balance_sheet[(asset::type)in.output.unit].in += output_bal;
+    load_signers();
     
-    if( signed_addresses.find( long_claim.pay_address ) != signed_addresses.end() )
+    if( is_signed_by( long_claim.pay_address ) )
     {
         // canceled orders can reclaim their dividends (assuming the order has been open long enough)
         //balance_sheet[asset::bts].in += output_bal;
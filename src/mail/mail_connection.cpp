@@ -256,18 +256,19 @@ namespace mail {
           while( !my->exec_sync_loop_complete.canceled() )
           {
              //ilog( "sync time ${t}", ("t",my->_sync_time) );
-             auto itr = my->_db->lower_bound( my->_sync_time );
+             // an old backlog sent to one peer should not evict the blocks other readers use,
+             // and the snapshot keeps the scan stable while new messages are stored
+             bts::db::scan_options opts;
+             opts.snapshot = my->_db->get_snapshot();
+             auto itr = my->_db->range( my->_sync_time + fc::microseconds(1), fc::time_point::maximum(), opts );
              if( !itr.valid() )
              {
               ilog( "no valid message found" );
              }
              while( itr.valid() && !my->exec_sync_loop_complete.canceled() )
              {
-                if( itr.key() > my->_sync_time )
-                {
-                   send( message( itr.value() ) );
-                   my->_sync_time = itr.key();
-                }
+                send( message( itr.value() ) );
+                my->_sync_time = itr.key();
                 ++itr;
              }
              fc::usleep( fc::seconds(15) );
@@ -3,11 +3,112 @@
 
 namespace bts {
 
+  uint160 merkle_hash( const uint160& left, const uint160& right )
+  {
+     uint160 pair[2] = { left, right };
+     static_assert( sizeof(pair) == 2*sizeof(uint160), "validate there is no padding between array items" );
+     return small_hash( (char*)pair, sizeof(pair) );
+  }
+
   uint160 merkle_branch::calculate_root()const
   {
      if( mid_states.size() == 0 ) return uint160();
-     if( mid_states.size() == 1 ) return mid_states[0];
-     FC_ASSERT( !"TODO: Merged Mining is Not Yet Implemented" );
+
+     uint160 node = mid_states[0];
+     for( uint32_t i = 1; i < mid_states.size(); ++i )
+     {
+        if( (branch >> (i-1)) & 1 ) node = merkle_hash( mid_states[i], node );
+        else                        node = merkle_hash( node, mid_states[i] );
+     }
+     return node;
+  }
+
+  merkle_tree::merkle_tree( std::vector<uint160> leaves )
+  {
+     auto s = leaves.size();
+     mtree.push_back( std::move(leaves) );
+     resize( s );
+  }
+
+  void merkle_tree::resize( uint64_t s )
+  {
+     if( mtree.size() == 0 ) mtree.resize(1);
+     mtree[0].resize( s );
+
+     uint32_t layer = 0;
+     for( ; mtree[layer].size() > 2; ++layer )
+     {
+        const auto& below = mtree[layer];
+        std::vector<uint160> above( (below.size() + 1) / 2 );
+        for( uint64_t i = 0; i < above.size(); ++i )
+        {
+           above[i] = merkle_hash( below[2*i], 2*i+1 < below.size() ? below[2*i+1] : uint160() );
+        }
+        if( mtree.size() == layer + 1 ) mtree.push_back( std::move(above) );
+        else                            mtree[layer+1] = std::move(above);
+     }
+     mtree.resize( layer + 1 );
+
+     const auto& top = mtree.back();
+     if( top.size() == 0 )      mroot = uint160();
+     else if( top.size() == 1 ) mroot = top[0];
+     else                       mroot = merkle_hash( top[0], top[1] );
+  }
+
+  uint64_t merkle_tree::size()const
+  {
+     return mtree.size() ? mtree[0].size() : 0;
+  }
+
+  void merkle_tree::set( uint64_t index, const uint160& val )
+  {
+     if( index > size() )
+        FC_THROW_EXCEPTION( out_of_range_exception, "index ${i} is past the end of the tree", ("i",index)("size",size()) );
+     if( index == size() )
+     {
+        // growing can add a layer, which is simpler to rebuild than patch
+        resize( size() + 1 );
+     }
+     mtree[0][index] = val;
+
+     uint64_t pos = index;
+     for( uint32_t layer = 0; layer + 1 < mtree.size(); ++layer )
+     {
+        const auto& below = mtree[layer];
+        pos /= 2;
+        mtree[layer+1][pos] = merkle_hash( below[2*pos], 2*pos+1 < below.size() ? below[2*pos+1] : uint160() );
+     }
+
+     const auto& top = mtree.back();
+     if( top.size() == 1 ) mroot = top[0];
+     else                  mroot = merkle_hash( top[0], top[1] );
+  }
+
+  uint160 merkle_tree::get( uint32_t index )
+  {
+     if( index >= size() )
+        FC_THROW_EXCEPTION( out_of_range_exception, "index ${i} is past the end of the tree", ("i",index)("size",size()) );
+     return mtree[0][index];
+  }
+
+  merkle_branch merkle_tree::get_branch( uint32_t index )const
+  {
+     if( index >= size() )
+        FC_THROW_EXCEPTION( out_of_range_exception, "index ${i} is past the end of the tree", ("i",index)("size",size()) );
+
+     merkle_branch b;
+     b.mid_states.push_back( mtree[0][index] );
+
+     uint64_t pos = index;
+     for( uint32_t layer = 0; layer < mtree.size() && mtree[layer].size() > 1; ++layer )
+     {
+        const auto& nodes = mtree[layer];
+        uint64_t sibling = pos ^ 1;
+        b.mid_states.push_back( sibling < nodes.size() ? nodes[sibling] : uint160() );
+        b.branch |= uint32_t(pos & 1) << layer;
+        pos /= 2;
+     }
+     return b;
   }
 
 } // namespace bts
@@ -87,7 +87,7 @@ namespace bts {
       }
 
       my->_accounts.open( wallet_cache_dir / "accounts", true );
-      my->_trx_db.open( wallet_cache_dir / "trx_db", true );
+      my->_trx_db.open( wallet_cache_dir / "trx_db", true, db::point_lookup_profile );
       my->_addr_index.open( wallet_cache_dir / "addr_index", true );
       my->_account_last_trx_index.open( wallet_cache_dir / "acnt_last_trx_index", true );
       my->_trx_last_address_index.open( wallet_cache_dir / "trx_last_address_index", true );
@@ -3,13 +3,18 @@
 
 #include <bts/blockchain/blockchain_wallet.hpp>
 #include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/blockchain_market_db.hpp>
+#include <bts/blockchain/blockchain_block_archive.hpp>
+#include <bts/blockchain/blockchain_trx_pool.hpp>
 #include <bts/blockchain/block.hpp>
+#include <bts/db/level_map.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/filesystem.hpp>
 #include <fc/io/json.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/io/raw.hpp>
 #include <iostream>
+#include <algorithm>
 #include <bts/config.hpp>
 
 #include <fstream>
@@ -46,6 +51,31 @@ bts::blockchain::trx_block create_test_genesis_block()
    return b;
 }
 
+/**
+ *  Pushes the genesis block followed by count blocks that each transfer part of
+ *  the genesis balance to a new address of w.
+ *
+ *  @return every pushed block, starting with genesis
+ */
+std::vector<trx_block> push_test_blocks( bts::blockchain::blockchain_db& chain, bts::blockchain::wallet& w, uint32_t count )
+{
+   std::vector<trx_block> blocks( 1, create_test_genesis_block() );
+   chain.push_block( blocks.back() );
+
+   w.import_key( test_genesis_private_key() );
+   w.scan_chain( chain );
+   w.set_fee_rate( chain.get_fee_rate() );
+   for( uint32_t i = 0; i < count; ++i )
+   {
+      w.set_stake( chain.get_stake() );
+      std::vector<signed_transaction> trxs( 1, w.transfer( asset(2.0,asset::bts), w.get_new_address() ) );
+      blocks.push_back( chain.generate_next_block( trxs ) );
+      chain.push_block( blocks.back() );
+      w.scan_chain( chain, blocks.back().block_num );
+   }
+   return blocks;
+}
+
 BOOST_AUTO_TEST_CASE( pts_address_test )
 {
   try {
@@ -277,3 +307,1237 @@ BOOST_AUTO_TEST_CASE( bitshares_wallet_test )
      throw;
   }
 }
+
+BOOST_AUTO_TEST_CASE( level_map_key_order )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::db::level_map<trx_num,uint32_t> trx_nums;
+     trx_nums.open( temp_dir.path() / "trx_nums" );
+
+     // little-endian packing would sort 256 before 1
+     trx_nums.store( trx_num( 256, 0 ), 3 );
+     trx_nums.store( trx_num( 1, 300 ), 2 );
+     trx_nums.store( trx_num( 1, 2 ), 1 );
+
+     auto itr = trx_nums.begin();
+     FC_ASSERT( itr.valid() && itr.key() == trx_num( 1, 2 ) && itr.value() == 1 );
+     ++itr;
+     FC_ASSERT( itr.valid() && itr.key() == trx_num( 1, 300 ) && itr.value() == 2 );
+     ++itr;
+     FC_ASSERT( itr.valid() && itr.key() == trx_num( 256, 0 ) && itr.value() == 3 );
+
+     FC_ASSERT( trx_nums.lower_bound( trx_num( 2, 0 ) ).key() == trx_num( 256, 0 ) );
+
+     // misses are reported without an exception
+     FC_ASSERT( trx_nums.contains( trx_num( 1, 300 ) ) );
+     FC_ASSERT( !trx_nums.contains( trx_num( 1, 301 ) ) );
+     FC_ASSERT( *trx_nums.try_fetch( trx_num( 256, 0 ) ) == 3 );
+     FC_ASSERT( !trx_nums.try_fetch( trx_num( 2, 0 ) ) );
+
+     // leveldb compares keys as unsigned bytes
+     auto before = []( const std::vector<char>& x, const std::vector<char>& y ) -> bool
+     {
+        int r = memcmp( x.data(), y.data(), std::min( x.size(), y.size() ) );
+        return r < 0 || (r == 0 && x.size() < y.size());
+     };
+     std::string a( "a" ), b( "a\0", 2 ), c( "ab" );
+     FC_ASSERT( before( bts::db::pack_key( a ), bts::db::pack_key( b ) ) );
+     FC_ASSERT( before( bts::db::pack_key( b ), bts::db::pack_key( c ) ) );
+     auto packed = bts::db::pack_key( b );
+     FC_ASSERT( bts::db::unpack_key<std::string>( packed.data(), packed.size() ) == b );
+  } 
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( unspent_index_rebuild_and_rollback )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+
+     std::vector<output_reference> created;
+     auto genesis_out = output_reference( create_test_genesis_block().trxs.front().id(), 0 );
+     {
+        bts::blockchain::blockchain_db chain;
+        chain.open( temp_dir.path() / "chain" );
+        auto blocks = push_test_blocks( chain, wallet, 2 );
+        for( uint16_t i = 0; i < blocks.back().trxs.back().outputs.size(); ++i )
+        {
+           created.push_back( output_reference( blocks.back().trxs.back().id(), i ) );
+        }
+        BOOST_CHECK( !chain.fetch_unspent( genesis_out ).valid() );
+        chain.close();
+     }
+
+     // an empty unspent table is rebuilt from the stored trxs
+     fc::remove_all( temp_dir.path() / "chain" / "unspent" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     BOOST_CHECK( !chain.fetch_unspent( genesis_out ).valid() );
+     for( auto itr = created.begin(); itr != created.end(); ++itr )
+     {
+        auto out = chain.fetch_unspent( *itr );
+        BOOST_REQUIRE( out.valid() );
+        BOOST_CHECK( out->source == chain.fetch_trx_num( itr->trx_hash ) );
+     }
+
+     // popping the block drops its outputs and restores the ones it spent
+     full_block                      popped;
+     std::vector<signed_transaction> popped_trxs;
+     chain.pop_block( popped, popped_trxs );
+     for( auto itr = created.begin(); itr != created.end(); ++itr )
+     {
+        BOOST_CHECK( !chain.fetch_unspent( *itr ).valid() );
+     }
+     for( auto in = popped_trxs.back().inputs.begin(); in != popped_trxs.back().inputs.end(); ++in )
+     {
+        BOOST_CHECK( chain.fetch_unspent( in->output_ref ).valid() );
+     }
+
+     // and the rolled back set is what is loaded, and replayed, on the next open
+     chain.close();
+     chain.open( temp_dir.path() / "chain" );
+     for( auto in = popped_trxs.back().inputs.begin(); in != popped_trxs.back().inputs.end(); ++in )
+     {
+        BOOST_CHECK( chain.fetch_unspent( in->output_ref ).valid() );
+     }
+     BOOST_CHECK( !chain.fetch_unspent( created.front() ).valid() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( parallel_signer_recovery )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+
+     // enough trxs that recovery is split across several workers
+     std::vector<signed_transaction> trxs;
+     for( uint32_t i = 0; i < 8 * BITSHARE_MIN_TRXS_PER_RECOVERY_THREAD; ++i )
+     {
+        signed_transaction trx = create_test_genesis_block().trxs.front();
+        trx.stake = i;
+        trx.sign( fc::ecc::private_key::generate_from_seed( fc::sha256::hash( (char*)&i, sizeof(i) ) ) );
+        if( i % 3 == 0 ) trx.sign( test_genesis_private_key() );
+        trxs.push_back( trx );
+     }
+
+     auto signers = chain.recover_signers( trxs );
+     BOOST_REQUIRE( signers.size() == trxs.size() );
+     for( uint32_t i = 0; i < trxs.size(); ++i )
+     {
+        BOOST_CHECK( signers[i] == trxs[i].get_signed_addresses() );
+        BOOST_CHECK( signers[i].size() == (i % 3 == 0 ? 2 : 1) );
+     }
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( signature_cache_matches_recovery )
+{
+   try {
+     std::vector<signed_transaction> trxs;
+     for( uint32_t i = 0; i < 3; ++i )
+     {
+        signed_transaction trx = create_test_genesis_block().trxs.front();
+        trx.stake = i;
+        trx.sign( test_genesis_private_key() );
+        trxs.push_back( trx );
+     }
+
+     signature_cache cache( 2 );
+     for( uint32_t pass = 0; pass < 2; ++pass )
+     {
+        for( uint32_t i = 0; i < trxs.size(); ++i )
+        {
+           BOOST_CHECK( cache.get_signers( trxs[i] ) == trxs[i].get_signed_addresses() );
+        }
+     }
+     BOOST_CHECK( cache.get_signers( trxs.back() ) == trxs.back().get_signed_addresses() );
+     BOOST_CHECK( cache.get_stats().hits >= 1 );
+     BOOST_CHECK( cache.get_stats().evictions >= 1 );
+     BOOST_CHECK( cache.get_stats().size == 2 );
+
+     // a trx with different signatures has a different id and is not served the old entry
+     signed_transaction resigned = trxs.front();
+     resigned.sign( fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "other", 5 ) ) );
+     BOOST_CHECK( cache.get_signers( resigned ) == resigned.get_signed_addresses() );
+     BOOST_CHECK( cache.get_signers( resigned ).size() == 2 );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( memoized_trx_id )
+{
+   try {
+     auto genesis = create_test_genesis_block();
+     signed_transaction trx = genesis.trxs.front();
+     auto unsigned_id = trx.id();
+     BOOST_CHECK( unsigned_id == trx.id() );
+
+     // signing changes the id
+     trx.sign( test_genesis_private_key() );
+     BOOST_CHECK( trx.id() != unsigned_id );
+
+     // direct modification must be followed by reset_id()
+     auto signed_id = trx.id();
+     trx.stake = 1;
+     trx.reset_id();
+     BOOST_CHECK( trx.id() != signed_id );
+     BOOST_CHECK( trx.id() == fc::raw::unpack<signed_transaction>( fc::raw::pack( trx ) ).id() );
+
+     auto header_id = genesis.id();
+     genesis.block_num = 1;
+     genesis.reset_id();
+     BOOST_CHECK( genesis.id() != header_id );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( pop_block_restores_head )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+
+     auto genesis = create_test_genesis_block();
+     chain.push_block( genesis );
+
+     bts::blockchain::wallet  wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     wallet.import_key( test_genesis_private_key() );
+     wallet.scan_chain( chain );
+     wallet.set_fee_rate( chain.get_fee_rate() );
+     wallet.set_stake( chain.get_stake() );
+
+     auto genesis_out = output_reference( genesis.trxs.front().id(), 0 );
+     BOOST_REQUIRE( chain.fetch_unspent( genesis_out ).valid() );
+
+     std::vector<signed_transaction> trxs( 1, wallet.transfer( asset(20.0f,asset::bts), wallet.get_new_address() ) );
+     auto block1 = chain.generate_next_block( trxs );
+     chain.push_block( block1 );
+     BOOST_CHECK( !chain.fetch_unspent( genesis_out ).valid() );
+
+     full_block                      popped;
+     std::vector<signed_transaction> popped_trxs;
+     chain.pop_block( popped, popped_trxs );
+
+     BOOST_CHECK( popped.id() == block1.id() );
+     BOOST_CHECK( popped_trxs.size() == block1.trxs.size() );
+     BOOST_CHECK( chain.head_block_num() == genesis.block_num );
+     BOOST_CHECK( chain.head_block_id() == genesis.id() );
+     BOOST_CHECK( chain.fetch_unspent( genesis_out ).valid() );
+     BOOST_CHECK( !chain.fetch_unspent( output_reference( block1.trxs.back().id(), 0 ) ).valid() );
+     BOOST_CHECK( !chain.fetch_trx( chain.fetch_trx_num( genesis_out.trx_hash ) ).meta_outputs[0].is_spent() );
+
+     // the popped block can be applied again as a one block fork
+     std::vector<trx_block> fork( 1, block1 );
+     chain.switch_to_fork( fork );
+     BOOST_CHECK( chain.head_block_id() == block1.id() );
+     BOOST_CHECK( !chain.fetch_unspent( genesis_out ).valid() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( market_book_top_of_book )
+{
+   try {
+     fc::temp_directory temp_dir;
+     auto owner = bts::address( test_genesis_private_key().get_public_key() );
+     auto order = [&]( double p, uint16_t idx ) -> market_order
+     {
+        return market_order( price( p, asset::bts, asset::usd ), output_reference( bts::uint160(), idx ) );
+     };
+     auto terms = [&]( double p ) -> order_terms
+     {
+        return order_terms( trx_output( claim_by_bid_output( owner, price( p, asset::bts, asset::usd ) ), 100, asset::usd ) );
+     };
+
+     {
+        market_db market;
+        market.open( temp_dir.path() / "market" );
+        BOOST_CHECK( !market.get_highest_bid( asset::usd, asset::bts ) );
+        BOOST_CHECK( !market.get_lowest_ask( asset::usd, asset::bts ) );
+
+        market.insert_bid( order( 1.0, 0 ), terms( 1.0 ) );
+        market.insert_bid( order( 2.0, 1 ), terms( 2.0 ) );
+        market.insert_ask( order( 4.0, 2 ), terms( 4.0 ) );
+        market.insert_ask( order( 3.0, 3 ), terms( 3.0 ) );
+        BOOST_CHECK( *market.get_highest_bid( asset::usd, asset::bts ) == order( 2.0, 1 ) );
+        BOOST_CHECK( *market.get_lowest_ask( asset::usd, asset::bts ) == order( 3.0, 3 ) );
+
+        market.remove_bid( order( 2.0, 1 ) );
+        market.remove_ask( order( 3.0, 3 ) );
+        BOOST_CHECK( *market.get_highest_bid( asset::usd, asset::bts ) == order( 1.0, 0 ) );
+        BOOST_CHECK( *market.get_lowest_ask( asset::usd, asset::bts ) == order( 4.0, 2 ) );
+
+        // batched changes reach the book when they are committed
+        market.start_batch();
+        market.insert_bid( order( 1.5, 4 ), terms( 1.5 ) );
+        market.remove_ask( order( 4.0, 2 ) );
+        BOOST_CHECK( *market.get_highest_bid( asset::usd, asset::bts ) == order( 1.0, 0 ) );
+        BOOST_CHECK( market.get_lowest_ask( asset::usd, asset::bts ).valid() );
+        market.commit_batch();
+        BOOST_CHECK( *market.get_highest_bid( asset::usd, asset::bts ) == order( 1.5, 4 ) );
+        BOOST_CHECK( !market.get_lowest_ask( asset::usd, asset::bts ) );
+     }
+
+     // the book is loaded back in price order
+     market_db market;
+     market.open( temp_dir.path() / "market" );
+     auto bids = market.get_bids( asset::usd, asset::bts );
+     BOOST_REQUIRE( bids.size() == 2 );
+     BOOST_CHECK( bids.front() == order( 1.0, 0 ) && bids.back() == order( 1.5, 4 ) );
+     BOOST_CHECK( *market.get_highest_bid( asset::usd, asset::bts ) == order( 1.5, 4 ) );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( order_terms_round_trip )
+{
+   try {
+     auto owner = bts::address( test_genesis_private_key().get_public_key() );
+     std::vector<trx_output> outs;
+     outs.push_back( trx_output( claim_by_bid_output( owner, price( 2.5, asset::bts, asset::usd ), 7 ), 100, asset::usd ) );
+     outs.push_back( trx_output( claim_by_long_output( owner, price( 0.5, asset::bts, asset::usd ), 9 ), 200, asset::bts ) );
+
+     fc::temp_directory temp_dir;
+     for( uint16_t i = 0; i < outs.size(); ++i )
+     {
+        order_terms terms( outs[i] );
+        auto out = terms.get_output();
+        BOOST_CHECK( out.amount == outs[i].amount );
+        BOOST_CHECK( out.unit == outs[i].unit );
+        BOOST_CHECK( out.claim_func == outs[i].claim_func );
+        BOOST_CHECK( out.claim_data == outs[i].claim_data );
+
+        auto unpacked = fc::raw::unpack<order_terms>( fc::raw::pack( terms ) );
+        BOOST_CHECK( unpacked.get_output().claim_data == outs[i].claim_data );
+     }
+
+     // terms stored with an order come back from the book after a reload
+     auto loc = market_order( price( 2.5, asset::bts, asset::usd ), output_reference( bts::uint160(), 0 ) );
+     {
+        market_db market;
+        market.open( temp_dir.path() / "market" );
+        market.insert_bid( loc, order_terms( outs[0] ) );
+     }
+     market_db market;
+     market.open( temp_dir.path() / "market" );
+     const auto& book = market.get_bid_book( asset::usd, asset::bts );
+     auto itr = book.find( loc );
+     BOOST_REQUIRE( itr != book.end() );
+     BOOST_CHECK( itr->second.get_output().claim_data == outs[0].claim_data );
+     BOOST_CHECK( itr->second.min_trade == 7 );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( match_orders_skips_clean_pairs )
+{
+   try {
+     fc::temp_directory temp_dir;
+     auto owner = bts::address( test_genesis_private_key().get_public_key() );
+     auto order = [&]( asset::type quote, asset::type base, uint16_t idx ) -> market_order
+     {
+        return market_order( price( 1.0, base, quote ), output_reference( bts::uint160(), idx ) );
+     };
+     auto terms = [&]( asset::type quote, asset::type base ) -> order_terms
+     {
+        return order_terms( trx_output( claim_by_bid_output( owner, price( 1.0, base, quote ) ), 100, quote ) );
+     };
+     typedef std::pair<asset::type,asset::type> pair_type;
+
+     {
+        market_db market;
+        market.open( temp_dir.path() / "market" );
+        market.insert_bid( order( asset::slv, asset::usd, 0 ), terms( asset::slv, asset::usd ) );
+        market.insert_bid( order( asset::gld, asset::bts, 1 ), terms( asset::gld, asset::bts ) );
+        market.insert_ask( order( asset::usd, asset::bts, 2 ), terms( asset::usd, asset::bts ) );
+
+        // ordered by base then quote no matter the order the books changed in
+        auto dirty = market.get_dirty_pairs();
+        BOOST_REQUIRE( dirty.size() == 3 );
+        BOOST_CHECK( dirty[0] == pair_type( asset::usd, asset::bts ) );
+        BOOST_CHECK( dirty[1] == pair_type( asset::gld, asset::bts ) );
+        BOOST_CHECK( dirty[2] == pair_type( asset::slv, asset::usd ) );
+
+        for( auto itr = dirty.begin(); itr != dirty.end(); ++itr )
+        {
+           market.mark_clean( itr->first, itr->second );
+        }
+        BOOST_CHECK( market.get_dirty_pairs().empty() );
+
+        // only the pair whose book changed is matched again
+        market.remove_bid( order( asset::gld, asset::bts, 1 ) );
+        dirty = market.get_dirty_pairs();
+        BOOST_REQUIRE( dirty.size() == 1 );
+        BOOST_CHECK( dirty[0] == pair_type( asset::gld, asset::bts ) );
+
+        // a batched change marks the pair when it is committed
+        market.mark_clean( asset::gld, asset::bts );
+        market.start_batch();
+        market.insert_ask( order( asset::slv, asset::usd, 3 ), terms( asset::slv, asset::usd ) );
+        BOOST_CHECK( market.get_dirty_pairs().empty() );
+        market.commit_batch();
+        BOOST_CHECK( market.get_dirty_pairs().size() == 1 );
+     }
+
+     // every pair with orders is matched after a restart
+     market_db market;
+     market.open( temp_dir.path() / "market" );
+     auto dirty = market.get_dirty_pairs();
+     BOOST_REQUIRE( dirty.size() == 2 );
+     BOOST_CHECK( dirty[0] == pair_type( asset::usd, asset::bts ) );
+     BOOST_CHECK( dirty[1] == pair_type( asset::slv, asset::usd ) );
+
+     // orders resting in several pairs are matched on several workers, the
+     // pairs that matched nothing are skipped by the next call
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     push_test_blocks( chain, wallet, 0 );
+
+     // each bid spends the change of the one before it
+     asset::type quotes[] = { asset::usd, asset::gld, asset::slv, asset::btc };
+     for( uint32_t i = 0; i < 4; ++i )
+     {
+        wallet.set_stake( chain.get_stake() );
+        std::vector<signed_transaction> bid( 1, wallet.bid( asset( 1.0, asset::bts ), price( 0.5 + i, asset::bts, quotes[i] ) ) );
+        auto blk = chain.generate_next_block( bid );
+        chain.push_block( blk );
+        wallet.scan_chain( chain, blk.block_num );
+     }
+     BOOST_CHECK( chain.match_orders().empty() );
+     BOOST_CHECK( chain.match_orders().empty() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( batched_input_reads_match_single_reads )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     auto blocks = push_test_blocks( chain, wallet, 4 );
+
+     // inputs from several blocks in an order that does not match the chain
+     std::vector<trx_input> inputs;
+     for( auto blk = blocks.rbegin(); blk != blocks.rend(); ++blk )
+     {
+        for( auto trx = blk->trxs.begin(); trx != blk->trxs.end(); ++trx )
+        {
+           for( uint16_t i = 0; i < trx->outputs.size(); ++i )
+           {
+              inputs.push_back( trx_input( output_reference( trx->id(), i ) ) );
+           }
+        }
+     }
+
+     auto batched = chain.fetch_inputs( inputs );
+     BOOST_REQUIRE( batched.size() == inputs.size() );
+     for( uint32_t i = 0; i < inputs.size(); ++i )
+     {
+        auto single = chain.fetch_inputs( std::vector<trx_input>( 1, inputs[i] ) );
+        BOOST_REQUIRE( single.size() == 1 );
+        BOOST_CHECK( batched[i].source == single[0].source );
+        BOOST_CHECK( batched[i].output_num == single[0].output_num );
+        BOOST_CHECK( fc::raw::pack( batched[i].output ) == fc::raw::pack( single[0].output ) );
+        BOOST_CHECK( batched[i].meta_output.trx_id == single[0].meta_output.trx_id );
+
+        auto mtrx = chain.fetch_trx( chain.fetch_trx_num( inputs[i].output_ref.trx_hash ) );
+        BOOST_CHECK( batched[i].source == chain.fetch_trx_num( inputs[i].output_ref.trx_hash ) );
+        BOOST_CHECK( fc::raw::pack( batched[i].output ) == fc::raw::pack( mtrx.outputs[inputs[i].output_ref.output_idx] ) );
+     }
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( block_trx_scan_matches_single_reads )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     auto blocks = push_test_blocks( chain, wallet, 3 );
+
+     for( uint32_t n = 0; n < blocks.size(); ++n )
+     {
+        auto scanned = chain.fetch_block_trxs( n );
+        BOOST_REQUIRE( scanned.size() == blocks[n].trxs.size() );
+        for( uint16_t t = 0; t < scanned.size(); ++t )
+        {
+           auto single = chain.fetch_trx( trx_num( n, t ) );
+           BOOST_CHECK( scanned[t].id() == single.id() );
+           BOOST_CHECK( scanned[t].id() == blocks[n].trxs[t].id() );
+           BOOST_CHECK( fc::raw::pack( scanned[t].meta_outputs ) == fc::raw::pack( single.meta_outputs ) );
+        }
+
+        auto full = chain.fetch_trx_block( n );
+        BOOST_CHECK( full.id() == blocks[n].id() );
+        BOOST_CHECK( full.trx_mroot == full.calculate_merkle_root() );
+     }
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( block_archive_read_back )
+{
+   try {
+     fc::temp_directory temp_dir;
+     std::vector<trx_block> blocks;
+     for( uint32_t n = 0; n < 5; ++n )
+     {
+        trx_block b = create_test_genesis_block();
+        b.block_num = n;
+        b.trxs.front().stake = n;
+        b.trxs.front().reset_id();
+        b.trx_mroot = b.calculate_merkle_root();
+        b.reset_id();
+        blocks.push_back( b );
+     }
+
+     {
+        block_archive archive;
+        archive.open( temp_dir.path() / "archive" );
+        for( auto itr = blocks.begin(); itr != blocks.end(); ++itr )
+        {
+           archive.append( *itr );
+        }
+        BOOST_CHECK( archive.size() == blocks.size() );
+        BOOST_CHECK( archive.fetch( 2 ).id() == blocks[2].id() );
+     }
+
+     // blocks read back from the mapped file after a restart match what was appended
+     block_archive archive;
+     archive.open( temp_dir.path() / "archive" );
+     BOOST_REQUIRE( archive.size() == blocks.size() );
+     for( uint32_t n = 0; n < blocks.size(); ++n )
+     {
+        auto b = archive.fetch( n );
+        BOOST_CHECK( b.id() == blocks[n].id() );
+        BOOST_REQUIRE( b.trxs.size() == 1 );
+        BOOST_CHECK( b.trxs.front().id() == blocks[n].trxs.front().id() );
+
+        auto packed = archive.fetch_packed( n );
+        BOOST_CHECK( std::vector<char>( packed.first, packed.first + packed.second ) == fc::raw::pack( blocks[n] ) );
+     }
+     BOOST_CHECK_THROW( archive.fetch( blocks.size() ), fc::exception );
+
+     archive.truncate( 3 );
+     BOOST_CHECK( archive.size() == 3 );
+     BOOST_CHECK_THROW( archive.fetch( 3 ), fc::exception );
+     archive.append( blocks[3] );
+     BOOST_CHECK( archive.fetch( 3 ).id() == blocks[3].id() );
+
+     // index entries that read back as zeros after a crash are dropped
+     archive.close();
+     {
+        std::ofstream idx( (temp_dir.path() / "archive" / "blocks.idx").generic_string().c_str(),
+                           std::ios::binary | std::ios::app );
+        uint64_t zero = 0;
+        idx.write( (const char*)&zero, sizeof(zero) );
+     }
+     archive.open( temp_dir.path() / "archive" );
+     BOOST_REQUIRE( archive.size() == 4 );
+     archive.append( std::vector<trx_block>( blocks.begin() + 4, blocks.end() ) );
+     BOOST_CHECK( archive.fetch( 4 ).id() == blocks[4].id() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( pruning_keeps_last_blocks )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+
+     const uint32_t depth = BITSHARE_MAX_UNDO_BLOCKS;
+     chain.enable_pruning( depth );
+     auto blocks = push_test_blocks( chain, wallet, depth + 4 );
+     uint32_t head = chain.head_block_num();
+     BOOST_REQUIRE( head == depth + 4 );
+
+     // the last depth blocks keep every trx
+     for( uint32_t n = head - depth + 1; n <= head; ++n )
+     {
+        BOOST_CHECK( chain.fetch_block_trxs( n ).size() == blocks[n].trxs.size() );
+     }
+
+     // older blocks keep their headers and unspent outputs but not their trxs
+     BOOST_CHECK_THROW( chain.fetch_block_trxs( 0 ), fc::exception );
+     BOOST_CHECK( chain.fetch_block( 0 ).id() == blocks[0].id() );
+     BOOST_CHECK_THROW( chain.fetch_trx_num( blocks[0].trxs.front().id() ), fc::exception );
+     for( uint32_t n = 1; n <= head - depth; ++n )
+     {
+        const auto& trx = blocks[n].trxs.back();
+        bool has_unspent = false;
+        for( uint16_t i = 0; i < trx.outputs.size(); ++i )
+        {
+           has_unspent |= chain.fetch_unspent( output_reference( trx.id(), i ) ).valid();
+        }
+        // a trx is only deleted once every one of its outputs is spent
+        if( has_unspent ) BOOST_CHECK_NO_THROW( chain.fetch_trx_num( trx.id() ) );
+     }
+
+     // the pruned range survives a restart
+     chain.close();
+     chain.open( temp_dir.path() / "chain" );
+     chain.enable_pruning( depth );
+     BOOST_CHECK_THROW( chain.fetch_block_trxs( 0 ), fc::exception );
+     BOOST_CHECK( chain.fetch_block_trxs( head ).size() == blocks[head].trxs.size() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( pruned_chain_pops_spends_of_pruned_blocks )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+
+     // genesis is pruned while block 1, which spends its only output, can still be popped
+     const uint32_t depth = BITSHARE_MAX_UNDO_BLOCKS;
+     chain.enable_pruning( depth );
+     auto blocks = push_test_blocks( chain, wallet, depth );
+     BOOST_REQUIRE( chain.head_block_num() == depth );
+     BOOST_CHECK_THROW( chain.fetch_block_trxs( 0 ), fc::exception );
+     BOOST_CHECK_NO_THROW( chain.fetch_trx_num( blocks[0].trxs.front().id() ) );
+
+     full_block                      popped;
+     std::vector<signed_transaction> popped_trxs;
+     while( chain.head_block_num() > 0 )
+     {
+        chain.pop_block( popped, popped_trxs );
+     }
+     BOOST_CHECK( chain.fetch_unspent( output_reference( blocks[0].trxs.front().id(), 0 ) ).valid() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( address_filter_skips_unrelated_blocks )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+
+     auto genesis = create_test_genesis_block();
+     chain.push_block( genesis );
+
+     auto genesis_owner = bts::address( test_genesis_private_key().get_public_key() );
+     auto stranger      = bts::address( fc::ecc::private_key::generate().get_public_key() );
+
+     auto filter = chain.fetch_address_filter( genesis.block_num );
+     BOOST_REQUIRE( filter.valid() );
+     BOOST_CHECK( filter->may_contain( genesis_owner ) );
+
+     BOOST_CHECK( chain.match_address_filters( std::vector<bts::address>( 1, genesis_owner ) ).size() == 1 );
+     BOOST_CHECK( chain.match_address_filters( std::vector<bts::address>( 1, stranger ) ).size()
+                  == size_t( filter->may_contain( stranger ) ) );
+     BOOST_CHECK( chain.match_address_filters( std::vector<bts::address>( 1, genesis_owner ), 1, 10 ).empty() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( merkle_branch_proves_trx )
+{
+   try {
+     for( uint32_t count = 1; count < 12; ++count )
+     {
+        full_block blk;
+        for( uint32_t i = 0; i < count; ++i )
+        {
+           blk.trx_ids.push_back( bts::small_hash( (char*)&i, sizeof(i) ) );
+        }
+        blk.trx_mroot = blk.calculate_merkle_root();
+
+        // appending one leaf at a time yields the same tree
+        bts::merkle_tree tree;
+        for( uint32_t i = 0; i < count; ++i )
+        {
+           tree.set( i, blk.trx_ids[i] );
+        }
+        BOOST_CHECK( tree.mroot == blk.trx_mroot );
+
+        for( uint32_t i = 0; i < count; ++i )
+        {
+           auto branch = tree.get_branch( i );
+           BOOST_CHECK( verify_trx_branch( blk, blk.trx_ids[i], branch ) );
+           BOOST_CHECK( !verify_trx_branch( blk, bts::uint160(), branch ) );
+        }
+     }
+
+     fc::temp_directory temp_dir;
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     auto genesis = create_test_genesis_block();
+     chain.push_block( genesis );
+
+     auto trx_id = genesis.trxs.front().id();
+     BOOST_CHECK( verify_trx_branch( chain.fetch_block( 0 ), trx_id, chain.fetch_trx_branch( trx_id ) ) );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_value_cache )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::db::level_map<uint32_t,std::string> values;
+     values.open( temp_dir.path() / "values" );
+     values.set_cache_size( 2 );
+
+     values.store( 1, "one" );
+     FC_ASSERT( values.fetch( 1 ) == "one" );
+     FC_ASSERT( values.fetch( 1 ) == "one" );
+     FC_ASSERT( values.get_cache_stats().hits == 1 );
+
+     // batched writes drop the cached value once they are applied
+     leveldb::WriteBatch batch;
+     values.store( 1, "uno", batch );
+     FC_ASSERT( values.fetch( 1 ) == "one" );
+     values.write( batch );
+     FC_ASSERT( values.fetch( 1 ) == "uno" );
+
+     values.remove( 1 );
+     FC_ASSERT( !values.try_fetch( 1 ) );
+
+     values.store( 2, "two" );
+     values.store( 3, "three" );
+     values.store( 4, "four" );
+     values.fetch( 2 ); values.fetch( 3 ); values.fetch( 4 );
+     FC_ASSERT( values.get_cache_stats().size == 2 );
+     FC_ASSERT( values.get_cache_stats().evictions >= 1 );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_profiles )
+{
+   try {
+     fc::temp_directory temp_dir;
+     {
+        bts::db::level_map<uint32_t,std::string> values;
+        values.open( temp_dir.path() / "values", true, bts::db::point_lookup_profile );
+        for( uint32_t i = 0; i < 1000; i += 2 )
+        {
+           values.store( i, std::to_string( i ) );
+        }
+        values.compact( 0, 1000 );
+        FC_ASSERT( values.contains( 10 ) );
+        FC_ASSERT( !values.contains( 11 ) );
+     }
+
+     // tables written with a bloom filter can be reopened under another profile
+     bts::db::db_environment::instance().set_block_cache_size( 1024*1024 );
+     bts::db::level_map<uint32_t,std::string> values;
+     values.open( temp_dir.path() / "values", false, bts::db::scan_profile );
+     FC_ASSERT( values.fetch( 998 ) == "998" );
+     FC_ASSERT( !values.try_fetch( 999 ) );
+     bts::db::db_environment::instance().set_block_cache_size( BTS_DB_BLOCK_CACHE_SIZE );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_visit )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::db::level_map<uint32_t,std::string> values;
+     values.open( temp_dir.path() / "values" );
+     values.store( 1, "one" );
+     values.store( 3, "three" );
+
+     // only the length prefix of the string is decoded
+     uint32_t length = 0;
+     auto read_length = [&]( fc::datastream<const char*>& ds ) { fc::unsigned_int l; fc::raw::unpack( ds, l ); length = l.value; };
+     FC_ASSERT( values.visit( 3, read_length ) );
+     FC_ASSERT( length == 5 );
+     FC_ASSERT( !values.visit( 2, read_length ) );
+
+     auto itr = values.find( 1 );
+     FC_ASSERT( itr.valid() );
+     itr.visit_value( read_length );
+     FC_ASSERT( length == 3 );
+     FC_ASSERT( itr.raw_value().size() == fc::raw::pack( std::string("one") ).size() );
+     FC_ASSERT( !values.find( 2 ).valid() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( level_map_range_and_snapshot )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::db::level_map<uint32_t,std::string> values;
+     values.open( temp_dir.path() / "values" );
+     for( uint32_t i = 0; i < 10; ++i )
+     {
+        values.store( i, std::to_string( i ) );
+     }
+
+     std::vector<uint32_t> keys;
+     for( auto itr = values.range( 3, 6 ); itr.valid(); ++itr )
+     {
+        keys.push_back( itr.key() );
+     }
+     FC_ASSERT( keys.size() == 3 && keys.front() == 3 && keys.back() == 5 );
+     FC_ASSERT( !values.range( 6, 6 ).valid() );
+
+     bts::db::scan_options opts;
+     opts.snapshot = values.get_snapshot();
+     values.remove( 4 );
+     values.store( 4, "four" );
+     values.store( 20, "20" );
+
+     keys.clear();
+     for( auto itr = values.range( 3, 100, opts ); itr.valid(); ++itr )
+     {
+        FC_ASSERT( itr.key() != 4 || itr.value() == "4" );
+        keys.push_back( itr.key() );
+     }
+     FC_ASSERT( keys.size() == 7 );
+     FC_ASSERT( values.range( 3, 100 ).valid() );
+     opts.snapshot.reset();
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( unpack_into_used_object_resets_id )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::db::level_map<uint32_t,trx_block> blocks;
+     blocks.open( temp_dir.path() / "blocks" );
+
+     auto genesis = create_test_genesis_block();
+     auto next    = genesis;
+     next.block_num = 1;
+     next.trxs.front().stake = 1;
+     next.trxs.front().reset_id();
+     next.reset_id();
+     blocks.store( 0, genesis );
+     blocks.store( 1, next );
+
+     // compute the ids of the object that is read into
+     trx_block used = genesis;
+     BOOST_REQUIRE( used.id() == genesis.id() );
+     BOOST_REQUIRE( used.trxs.front().id() == genesis.trxs.front().id() );
+
+     uint32_t num = 0;
+     BOOST_REQUIRE( blocks.last( num, used ) );
+     BOOST_CHECK( num == 1 );
+     BOOST_CHECK( used.id() == next.id() );
+     BOOST_CHECK( used.trxs.front().id() == next.trxs.front().id() );
+
+     auto itr = blocks.begin();
+     BOOST_REQUIRE( itr.valid() );
+     itr.value( used );
+     BOOST_CHECK( used.id() == genesis.id() );
+     BOOST_CHECK( used.trxs.front().id() == genesis.trxs.front().id() );
+
+     BOOST_CHECK( blocks.fetch( 1 ).id() == next.id() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( failed_fork_restores_prior_head )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     auto blocks = push_test_blocks( chain, wallet, 3 );
+     auto head_id = chain.head_block_id();
+     auto last_out = output_reference( blocks.back().trxs.back().id(), 0 );
+
+     // the second fork block spends an output that does not exist, so the
+     // switch fails after the first fork block was pushed
+     trx_block bad = blocks[2];
+     bad.trxs.back().inputs.front().output_ref.output_idx = 200;
+     bad.trxs.back().reset_id();
+     bad.trx_mroot = bad.calculate_merkle_root();
+     bad.reset_id();
+
+     std::vector<trx_block> fork;
+     fork.push_back( blocks[1] );
+     fork.push_back( bad );
+     BOOST_CHECK_THROW( chain.switch_to_fork( fork ), fc::exception );
+     BOOST_CHECK( chain.head_block_num() == blocks.back().block_num );
+     BOOST_CHECK( chain.head_block_id() == head_id );
+     BOOST_CHECK( chain.fetch_unspent( last_out ).valid() );
+
+     // a fork that does not link to the chain is rejected before anything is popped
+     fork.front().prev = bts::uint160();
+     fork.front().reset_id();
+     BOOST_CHECK_THROW( chain.switch_to_fork( fork ), fc::exception );
+     BOOST_CHECK( chain.head_block_id() == head_id );
+
+     // nothing is left in the journal for open() to restore
+     chain.close();
+     chain.open( temp_dir.path() / "chain" );
+     BOOST_CHECK( chain.head_block_id() == head_id );
+     BOOST_CHECK( chain.fetch_unspent( last_out ).valid() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( trx_pool_drops_stale_trxs )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     push_test_blocks( chain, wallet, 1 );
+
+     wallet.set_stake( chain.get_stake() );
+     auto trx = wallet.transfer( asset(2.0,asset::bts), wallet.get_new_address() );
+     trx_pool pool( chain );
+     pool.add( trx );
+     BOOST_REQUIRE( pool.select().size() == 1 );
+
+     // the trx is included without telling the pool
+     chain.push_block( chain.generate_next_block( std::vector<signed_transaction>( 1, trx ) ) );
+     BOOST_CHECK( pool.select().size() == 0 );
+     BOOST_CHECK( pool.size() == 0 );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( snapshot_export_import )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+
+     auto blocks = push_test_blocks( chain, wallet, 4 );
+     uint32_t head = chain.head_block_num();
+     chain.export_snapshot( temp_dir.path() / "head.snap" );
+     chain.export_snapshot( temp_dir.path() / "mid.snap", 2 );
+
+     // the head snapshot has the same head block and unspent outputs
+     {
+        bts::blockchain::blockchain_db imported;
+        imported.open( temp_dir.path() / "head" );
+        imported.import_snapshot( temp_dir.path() / "head.snap" );
+        BOOST_CHECK( imported.head_block_id() == chain.head_block_id() );
+        BOOST_CHECK( imported.fetch_full_block( head ).trx_ids == chain.fetch_full_block( head ).trx_ids );
+        BOOST_CHECK( imported.fetch_trx_block( head ).calculate_merkle_root() == blocks[head].trx_mroot );
+        for( const auto& trx : blocks[head].trxs )
+        {
+           for( uint16_t i = 0; i < trx.outputs.size(); ++i )
+           {
+              output_reference ref( trx.id(), i );
+              BOOST_CHECK( imported.fetch_unspent( ref ).valid() == chain.fetch_unspent( ref ).valid() );
+           }
+        }
+     }
+
+     // a snapshot at an earlier height accepts the blocks that followed it
+     {
+        bts::blockchain::blockchain_db imported;
+        imported.open( temp_dir.path() / "mid" );
+        imported.import_snapshot( temp_dir.path() / "mid.snap" );
+        BOOST_CHECK( imported.head_block_id() == blocks[2].id() );
+        for( uint32_t n = 3; n <= head; ++n )
+        {
+           imported.push_block( blocks[n] );
+        }
+        BOOST_CHECK( imported.head_block_id() == chain.head_block_id() );
+     }
+
+     // a snapshot whose head contradicts a checkpoint is rejected
+     {
+        bts::blockchain::blockchain_db imported;
+        imported.open( temp_dir.path() / "checkpoint" );
+        imported.add_checkpoint( head, blocks[2].id() );
+        BOOST_CHECK_THROW( imported.import_snapshot( temp_dir.path() / "head.snap" ), fc::exception );
+        BOOST_CHECK( imported.head_block_num() == INVALID_BLOCK_NUM );
+     }
+
+     // a damaged snapshot fails its checksum
+     {
+        std::fstream file( (temp_dir.path() / "head.snap").generic_string().c_str(),
+                           std::ios::in | std::ios::out | std::ios::binary );
+        file.seekg( 16 );
+        char c = 0;
+        file.read( &c, 1 );
+        file.seekp( 16 );
+        c ^= 0x01;
+        file.write( &c, 1 );
+        file.close();
+
+        bts::blockchain::blockchain_db imported;
+        imported.open( temp_dir.path() / "damaged" );
+        BOOST_CHECK_THROW( imported.import_snapshot( temp_dir.path() / "head.snap" ), fc::exception );
+        BOOST_CHECK( imported.head_block_num() == INVALID_BLOCK_NUM );
+     }
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( checkpoint_mismatch_rejected )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     auto blocks = push_test_blocks( chain, wallet, 4 );
+
+     bts::blockchain::blockchain_db trusted;
+     trusted.open( temp_dir.path() / "trusted" );
+     trusted.add_checkpoint( 1, blocks[1].id() );
+     trusted.add_checkpoint( 3, blocks[2].id() );
+     for( uint32_t n = 0; n <= 2; ++n )
+     {
+        trusted.push_block( blocks[n] );
+     }
+
+     // block 3 is rejected and block 2, accepted on trust, is validated again
+     BOOST_CHECK_THROW( trusted.push_block( blocks[3] ), fc::exception );
+     BOOST_CHECK( trusted.head_block_num() == 2 );
+     BOOST_CHECK( trusted.head_block_id() == blocks[2].id() );
+
+     // the mismatch is not forgotten by a restart
+     trusted.close();
+     trusted.open( temp_dir.path() / "trusted" );
+     trusted.add_checkpoint( 3, blocks[2].id() );
+     BOOST_CHECK_THROW( trusted.push_block( blocks[3] ), fc::exception );
+     BOOST_CHECK( trusted.head_block_num() == 2 );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( checkpoint_beyond_undo_window )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     const uint32_t depth = BITSHARE_MAX_UNDO_BLOCKS;
+     auto blocks = push_test_blocks( chain, wallet, depth + 2 );
+
+     // a bad checkpoint deeper than the undo window must not stop the chain
+     bts::blockchain::blockchain_db trusted;
+     trusted.open( temp_dir.path() / "trusted" );
+     trusted.add_checkpoint( depth + 2, blocks[0].id() );
+     for( uint32_t n = 0; n <= depth + 1; ++n )
+     {
+        trusted.push_block( blocks[n] );
+     }
+     BOOST_CHECK_THROW( trusted.push_block( blocks[depth+2] ), fc::exception );
+     BOOST_CHECK( trusted.head_block_num() == depth + 1 );
+
+     full_block                      popped;
+     std::vector<signed_transaction> popped_trxs;
+     trusted.pop_block( popped, popped_trxs );
+     trusted.push_block( blocks[depth+1] );
+     BOOST_CHECK( trusted.head_block_id() == blocks[depth+1].id() );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
+
+/** checks the address index against every signature output of blocks */
+void check_address_index( bts::blockchain::blockchain_db& chain, const std::vector<trx_block>& blocks )
+{
+   for( auto blk = blocks.begin(); blk != blocks.end(); ++blk )
+   {
+      for( auto trx = blk->trxs.begin(); trx != blk->trxs.end(); ++trx )
+      {
+         for( uint16_t i = 0; i < trx->outputs.size(); ++i )
+         {
+            if( trx->outputs[i].claim_func != claim_by_signature ) continue;
+            auto owner   = trx->outputs[i].as<claim_by_signature_output>().owner;
+            output_reference ref( trx->id(), i );
+
+            auto history = chain.fetch_address_history( owner );
+            BOOST_CHECK( std::find( history.begin(), history.end(), ref ) != history.end() );
+
+            auto unspent = chain.fetch_address_unspent( owner );
+            bool listed  = false;
+            for( auto itr = unspent.begin(); itr != unspent.end(); ++itr )
+            {
+               BOOST_CHECK( chain.fetch_unspent( itr->first ).valid() );
+               listed |= itr->first == ref;
+            }
+            BOOST_CHECK( listed == chain.fetch_unspent( ref ).valid() );
+         }
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE( address_index_queries )
+{
+   try {
+     fc::temp_directory temp_dir;
+     bts::blockchain::wallet wallet;
+     wallet.open( temp_dir.path() / "wallet" );
+     bts::blockchain::blockchain_db chain;
+     chain.open( temp_dir.path() / "chain" );
+     chain.enable_address_index();
+
+     auto blocks = push_test_blocks( chain, wallet, 3 );
+     check_address_index( chain, blocks );
+
+     // the outputs of a popped block leave the index
+     full_block popped;
+     std::vector<signed_transaction> popped_trxs;
+     chain.pop_block( popped, popped_trxs );
+     blocks.pop_back();
+     check_address_index( chain, blocks );
+     const auto& last = popped_trxs.back();
+     auto owner   = last.outputs.front().as<claim_by_signature_output>().owner;
+     auto history = chain.fetch_address_history( owner );
+     BOOST_CHECK( std::find( history.begin(), history.end(), output_reference( last.id(), 0 ) ) == history.end() );
+
+     // a block pushed while the index is disabled is indexed when it is enabled again
+     chain.close();
+     chain.open( temp_dir.path() / "chain" );
+     chain.push_block( trx_block( popped, popped_trxs ) );
+     chain.close();
+     chain.open( temp_dir.path() / "chain" );
+     chain.enable_address_index();
+     blocks.push_back( trx_block( popped, popped_trxs ) );
+     check_address_index( chain, blocks );
+  }
+  catch ( const fc::exception& e )
+  {
+     elog( "${e}", ("e", e.to_detail_string() ) );
+     throw;
+  }
+}
@@ -0,0 +1,122 @@
+#include <bts/blockchain/blockchain_db.hpp>
+#include <bts/blockchain/blockchain_wallet.hpp>
+#include <bts/config.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/time.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include <stdlib.h>
+
+using namespace bts::blockchain;
+
+fc::ecc::private_key genesis_private_key()
+{
+    return fc::ecc::private_key::generate_from_seed( fc::sha256::hash( "genesis", 7 ) );
+}
+
+trx_block create_benchmark_genesis_block()
+{
+   trx_block b;
+   b.version      = 0;
+   b.prev         = block_id_type();
+   b.block_num    = 0;
+   b.total_shares = 100*COIN;
+   b.timestamp    = fc::time_point::from_iso_string("20131201T054434");
+
+   signed_transaction coinbase;
+   coinbase.version = 0;
+   coinbase.outputs.push_back( 
+      trx_output( claim_by_signature_output( bts::address(genesis_private_key().get_public_key()) ), 100*COIN, asset::bts) );
+
+   b.trxs.emplace_back( std::move(coinbase) );
+   b.trx_mroot   = b.calculate_merkle_root();
+   return b;
+}
+
+/**
+ *  Measures the latency of popping blocks and of switching to a fork as the
+ *  depth of the reorganization grows.  The chain is first extended by a 
+ *  prefix of blocks so that any cost proportional to the chain length rather
+ *  than the reorganized blocks would show up.
+ *
+ *  usage: reorg_benchmark [max_depth=64] [prefix_blocks=256]
+ */
+int main( int argc, char** argv )
+{
+   try {
+      uint32_t max_depth = argc > 1 ? atoi( argv[1] ) : 64;
+      uint32_t prefix    = argc > 2 ? atoi( argv[2] ) : 256;
+      FC_ASSERT( max_depth <= BITSHARE_MAX_UNDO_BLOCKS );
+
+      fc::temp_directory temp_dir;
+      blockchain_db chain;
+      chain.open( temp_dir.path() / "chain" );
+      chain.push_block( create_benchmark_genesis_block() );
+
+      wallet w;
+      w.open( temp_dir.path() / "wallet" );
+      w.import_key( genesis_private_key() );
+      w.scan_chain( chain );
+      w.set_fee_rate( chain.get_fee_rate() );
+
+      std::cout << "building " << prefix + max_depth << " blocks\n";
+      for( uint32_t i = 0; i < prefix + max_depth; ++i )
+      {
+         w.set_stake( chain.get_stake() );
+         std::vector<signed_transaction> trxs( 1, w.transfer( asset(0.01,asset::bts), w.get_new_address() ) );
+         auto blk = chain.generate_next_block( trxs );
+         chain.push_block( blk );
+         w.scan_chain( chain, blk.block_num );
+      }
+
+      std::cout << std::setw(8) << "depth" 
+                << std::setw(14) << "pop us" 
+                << std::setw(14) << "reorg us" 
+                << std::setw(18) << "reorg us/block" << "\n";
+
+      for( uint32_t depth = 1; depth <= max_depth; depth *= 2 )
+      {
+         std::vector<trx_block> fork;
+         for( uint32_t n = chain.head_block_num() + 1 - depth; n <= chain.head_block_num(); ++n )
+         {
+            fork.push_back( chain.fetch_trx_block( n ) );
+         }
+
+         // pop alone, then put the same blocks back
+         auto start = fc::time_point::now();
+         for( uint32_t i = 0; i < depth; ++i )
+         {
+            full_block                      b;
+            std::vector<signed_transaction> trxs;
+            chain.pop_block( b, trxs );
+         }
+         auto pop_time = fc::time_point::now() - start;
+         for( auto itr = fork.begin(); itr != fork.end(); ++itr )
+         {
+            chain.push_block( *itr );
+         }
+
+         // a full reorganization onto a fork of the same depth
+         start = fc::time_point::now();
+         chain.switch_to_fork( fork );
+         auto reorg_time = fc::time_point::now() - start;
+
+         std::cout << std::setw(8)  << depth 
+                   << std::setw(14) << pop_time.count() 
+                   << std::setw(14) << reorg_time.count() 
+                   << std::setw(18) << reorg_time.count() / depth << "\n";
+      }
+      chain.close();
+   } 
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return -1;
+   }
+   return 0;
+}